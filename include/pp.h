@@ -2,9 +2,14 @@
 
 #include "esp_event.h"
 
-#define MAX_PAR_NAME 16
+#define MAX_PAR_NAME 64
+#define PP_GROUP_SEPARATOR '/'
 #define MAX_ARRAY_SIZE 2048
 #define ABS_MAX_ARRAY_SIZE 4096
+#define MAX_DERIVED_INPUTS 8
+#define MAX_WRITE_BATCH 32
+#define PP_ARENA_MAX_BLOCK 512
+#define PP_RENDER_FORMAT_MAX 16
 
 #ifdef __cplusplus
 extern "C"
@@ -18,6 +23,34 @@ extern "C"
         void(*free_fn)(void *ptr);
     } pp_hooks;
 
+    /// @brief Categories of memory used by the library, see pp_get_memory_stats().
+    typedef enum
+    {
+        PP_MEM_STATIC = 0,    ///< Parameter table and write slots, allocated once.
+        PP_MEM_NAMES,         ///< Name lookup map.
+        PP_MEM_SUBSCRIPTIONS, ///< Subscription lists, owner and fast loop tables.
+        PP_MEM_PATTERNS,      ///< Pattern subscriptions.
+        PP_MEM_DERIVED,       ///< Dependency lists of derived parameters.
+        PP_MEM_EVENTS,        ///< Event payloads built before posting, the event loop makes its own copy.
+        PP_MEM_BUFFERS,       ///< Buffers returned to the caller and freed with pp_free().
+        PP_MEM_MODULES,       ///< Persistence, bridge and trace modules.
+        PP_MEM_CACHE,         ///< Render caches and the cached JSON document.
+        PP_MEM_CATEGORIES,    ///< Number of categories.
+    } pp_mem_category_t;
+
+    /// @brief Memory used by the library, in bytes requested from the hooks.
+    typedef struct
+    {
+        size_t current[PP_MEM_CATEGORIES]; ///< Bytes in use by category.
+        size_t peak[PP_MEM_CATEGORIES];    ///< Highest bytes in use by category.
+        size_t total;                      ///< Bytes in use in all categories.
+        size_t total_peak;                 ///< Highest bytes in use in all categories.
+        size_t allocations;                ///< Heap allocations in use.
+        size_t failures;                   ///< Failed heap allocations.
+        size_t arena_size;                 ///< Size of the arena, 0 without one.
+        size_t arena_used;                 ///< Bytes of the arena handed out, freed blocks are reused.
+    } pp_memory_stats_t;
+
     /// @brief Enumeration of parameter types.
     typedef enum
     {
@@ -35,6 +68,80 @@ extern "C"
         TYPE_HIDE = 0x80000000,    ///< Hidden type (not shown in the list).
     } parameter_type_t;
 
+    /// @brief Value of a scalar parameter.
+    typedef union
+    {
+        int32_t i32; ///< TYPE_INT32 value.
+        int64_t i64; ///< TYPE_INT64 value.
+        float f;     ///< TYPE_FLOAT value.
+        bool b;      ///< TYPE_BOOL value.
+    } pp_value_t;
+
+    /// @brief Flags telling which fields of pp_meta_t are used.
+    typedef enum
+    {
+        PP_META_RANGE = 0x1,     ///< Writes must be within min and max. NaN and infinities are refused with RANGE or STEP.
+        PP_META_STEP = 0x2,      ///< Writes are rounded to a multiple of step, counted from min if a range is set.
+        PP_META_ENUM = 0x4,      ///< Writes must be one of enum_values.
+        PP_META_MAX_LEN = 0x8,   ///< String writes must be at most max_len characters.
+        PP_META_READ_ONLY = 0x10, ///< All writes are refused.
+        PP_META_CLAMP = 0x20,    ///< Writes outside the range are clamped instead of refused, to a step if STEP is set.
+    } pp_meta_flags_t;
+
+    /// @brief Metadata describing the values a parameter accepts.
+    typedef struct
+    {
+        uint32_t flags;             ///< Combination of pp_meta_flags_t.
+        double min;                 ///< Lowest allowed value.
+        double max;                 ///< Highest allowed value.
+        double step;                ///< Step between allowed values.
+        const int32_t *enum_values; ///< Allowed values, not copied.
+        size_t enum_count;          ///< Number of allowed values.
+        size_t max_len;             ///< Longest allowed string.
+    } pp_meta_t;
+
+    /// @brief Status of an asynchronous write.
+    typedef enum
+    {
+        PP_WRITE_PENDING = 0, ///< Posted, not handled by the owner yet.
+        PP_WRITE_APPLIED,     ///< The owner's write callback accepted the value.
+        PP_WRITE_REJECTED,    ///< The owner's write callback called pp_write_reject().
+        PP_WRITE_FAILED,      ///< Not reported, a write that can not be posted returns token 0.
+        PP_WRITE_UNKNOWN,     ///< Unknown token, or the result was overwritten by newer writes.
+    } pp_write_status_t;
+
+    /// @brief Delivery priority of a parameter or a subscription.
+    typedef enum
+    {
+        PP_PRIORITY_NORMAL = 0, ///< Delivered on the receiver's event loop.
+        PP_PRIORITY_HIGH,       ///< Delivered on the receiver's fast loop if it has one, and posted before normal subscriptions.
+    } pp_priority_t;
+
+    /// @brief Condition on the new state for a filtered subscription, see pp_subscribe_filter().
+    typedef enum
+    {
+        PP_FILTER_ABOVE = 0, ///< Value greater than low.
+        PP_FILTER_BELOW,     ///< Value less than low.
+        PP_FILTER_RISING,    ///< Value becomes greater than low.
+        PP_FILTER_FALLING,   ///< Value becomes less than low.
+        PP_FILTER_ENTER,     ///< Value comes into the range [low, high].
+        PP_FILTER_EXIT,      ///< Value leaves the range [low, high].
+        PP_FILTER_EQUAL,     ///< Value equal to low.
+        PP_FILTER_MASK,      ///< Any bit of mask set, integer types only.
+    } pp_filter_kind_t;
+
+    /// @brief Filter for a subscription, evaluated before the new state is posted to the subscriber.
+    typedef struct
+    {
+        pp_filter_kind_t kind; ///< The condition.
+        double low;            ///< Threshold, compared value or lower bound of the range.
+        double high;           ///< Upper bound of the range.
+        uint64_t mask;         ///< Bits for PP_FILTER_MASK.
+    } pp_filter_t;
+
+    /// @brief Token identifying an asynchronous write, 0 is never a valid token.
+    typedef uint32_t pp_write_token_t;
+
     /// @brief Structure representing a float array.
     typedef struct
     {
@@ -66,9 +173,16 @@ extern "C"
         size_t subscriptions;     ///< Number of subscriptions to the parameter.
     } pp_info_t;
 
+    /// @brief Position of an iteration over all parameters, see pp_get_next().
+    typedef size_t pp_cursor_t;
+#define PP_CURSOR_INIT 0
+
     typedef struct public_parameter_t public_parameter_t; ///< Opaque handle to a public parameter.
-    typedef public_parameter_t *pp_t;       ///< Opaque handle to a parameter.
+    /// @brief Opaque handle to a parameter. Handles of deleted parameters are refused by all functions,
+    /// also after the parameter's slot is reused by a new parameter.
+    typedef public_parameter_t *pp_t;
     typedef void *pp_event_t; ///< Opaque handle to an event.
+    typedef struct pp_pattern_t pp_pattern_t; ///< Opaque handle to a pattern subscription.
 
     /// @brief Callback function to convert a parameter to a JSON string.
     /// @param pp The parameter to convert.
@@ -77,8 +191,40 @@ extern "C"
     /// @param json If true, a JSON document is returned; otherwise, a single JSON variable is returned.
     typedef bool (*pp_json_cb_t)(pp_t pp, const char* format, char *buf, size_t *bufsize, bool json);
 
+    /// @brief Callback function telling a producer that the demand for a parameter changed.
+    /// @param pp The parameter.
+    /// @param subscribe True when the first subscriber arrives or the requested rate changes,
+    /// false when the last subscriber leaves.
     typedef void (*pp_subscribe_cb_t)(pp_t pp, bool subscribe);
 
+    /// @brief Callback function called on the owner event loop when an asynchronous write completes.
+    /// @param token The token returned when the write was posted.
+    /// @param status The result of the write.
+    /// @param applied The value of the parameter after the write callback, NULL for batches and non scalar types.
+    /// @param context The context pointer given when the write was posted.
+    typedef void (*pp_write_done_cb_t)(pp_write_token_t token, pp_write_status_t status, const pp_value_t *applied, void *context);
+
+    /// @brief One write in a batch.
+    typedef struct
+    {
+        pp_t pp;          ///< The parameter, must be a scalar type.
+        pp_value_t value; ///< The value to write.
+    } pp_write_item_t;
+
+    /// @brief Structure describing the demand for a parameter.
+    typedef struct
+    {
+        size_t subscribers;   ///< Number of subscribers.
+        uint32_t max_rate_hz; ///< Highest update rate requested by a subscriber, 0 if none requested one.
+    } pp_demand_t;
+
+    /// @brief Callback function computing the value of a derived parameter.
+    /// @param inputs The input parameters, read them with pp_get_float_value().
+    /// @param count The number of inputs.
+    /// @param context The context pointer given when the parameter was created.
+    /// @return The new value of the derived parameter.
+    typedef float (*pp_derive_cb_t)(const pp_t *inputs, size_t count, void *context);
+
     /// @brief Get a parameter by its name.
     /// @param name The name of the parameter.
     /// @return A handle to the parameter, or NULL if not found.
@@ -86,7 +232,7 @@ extern "C"
 
     /// @brief Get the float value of a parameter.
     /// @param pp The parameter handle.
-    /// @return The float value of the parameter.
+    /// @return The float value of the parameter, int32, int64 and bool values are converted. 0 for other types.
     float pp_get_float_value(pp_t pp);
 
     /// @brief Get the byte size required for a float array of a given length.
@@ -153,7 +299,7 @@ extern "C"
     void pp_reset_int16_array(pp_int16_array_t *array);
 
     /// @brief Create a new int32 parameter.
-    /// @param name The name of the parameter.
+    /// @param name The name of the parameter, at most MAX_PAR_NAME characters. Not copied, must remain valid.
     /// @param evloop The event loop associated with the parameter.
     /// @param event_write_cb The callback function for write events.
     /// @param valueptr The pointer to the parameter's value.
@@ -176,6 +322,28 @@ extern "C"
     /// @return A handle to the created parameter.
     pp_t pp_create_float(const char *name, const pp_evloop_t *evloop, esp_event_handler_t event_write_cb, float *valueptr);
 
+    /// @brief Create a float parameter computed from other parameters.
+    /// The value is recomputed lazily when read, and when an input posts a new state and the
+    /// derived parameter has subscribers. Dependent parameters are recomputed in dependency order
+    /// so subscribers never see a value computed from partially updated inputs.
+    /// @param name The name of the parameter.
+    /// @param evloop The event loop associated with the parameter.
+    /// @param inputs The input parameters, read through their value pointers. Scalar types only.
+    /// @param count The number of inputs, at most MAX_DERIVED_INPUTS.
+    /// @param cb The callback computing the value, e.g. pp_derive_product.
+    /// @param context The context pointer passed to the callback.
+    /// @return A handle to the created parameter.
+    pp_t pp_create_derived_float(const char *name, const pp_evloop_t *evloop, const pp_t *inputs, size_t count, pp_derive_cb_t cb, void *context);
+
+    /// @brief Derive callback returning the sum of all inputs.
+    float pp_derive_sum(const pp_t *inputs, size_t count, void *context);
+
+    /// @brief Derive callback returning the product of all inputs.
+    float pp_derive_product(const pp_t *inputs, size_t count, void *context);
+
+    /// @brief Derive callback returning the mean of all inputs.
+    float pp_derive_mean(const pp_t *inputs, size_t count, void *context);
+
     /// @brief Create a new float array parameter.
     /// @param name The name of the parameter.
     /// @param evloop The event loop associated with the parameter.
@@ -205,9 +373,9 @@ extern "C"
     /// @return A handle to the created parameter.
     pp_t pp_create_string(const char *name, const pp_evloop_t *evloop, esp_event_handler_t event_write_cb);
 
-    /// @brief Delete a parameter.
+    /// @brief Delete a parameter. Its subscriptions and write handler are unregistered.
     /// @param pp The parameter handle.
-    /// @return True if the parameter was successfully deleted, false otherwise.
+    /// @return True if the parameter was successfully deleted, false otherwise or if it is input to a derived parameter.
     bool pp_delete(pp_t pp);
 
     /// @brief Post a new state for an int32 parameter.
@@ -274,7 +442,8 @@ extern "C"
     /// @brief Post a write event for an int32 parameter.
     /// @param pp The parameter handle.
     /// @param value The new int32 value.
-    /// @return True if the write event was successfully posted, false otherwise.
+    /// @return True if the write event was successfully posted, false otherwise or if the parameter
+    /// is not an int32 or the value is refused by its metadata, see pp_set_meta().
     bool pp_post_write_int32(pp_t pp, int32_t value);
 
     /// @brief Post a write event for an int64 parameter.
@@ -301,6 +470,54 @@ extern "C"
     /// @return True if the write event was successfully posted, false otherwise.
     bool pp_post_write_string(pp_t pp, const char *str);
 
+    /// @brief Post an asynchronous write event for a boolean parameter.
+    /// @param pp The parameter handle.
+    /// @param value The new boolean value.
+    /// @param done_cb Called on the owner event loop when the write is handled, may be NULL.
+    /// @param context The context pointer passed to done_cb.
+    /// @return A token to follow the write with, or 0 if the write could not be posted. done_cb is
+    /// then not called.
+    pp_write_token_t pp_post_write_bool_async(pp_t pp, bool value, pp_write_done_cb_t done_cb, void *context);
+
+    /// @brief Post an asynchronous write event for an int32 parameter.
+    /// @see pp_post_write_bool_async
+    pp_write_token_t pp_post_write_int32_async(pp_t pp, int32_t value, pp_write_done_cb_t done_cb, void *context);
+
+    /// @brief Post an asynchronous write event for an int64 parameter.
+    /// @see pp_post_write_bool_async
+    pp_write_token_t pp_post_write_int64_async(pp_t pp, int64_t value, pp_write_done_cb_t done_cb, void *context);
+
+    /// @brief Post an asynchronous write event for a float parameter.
+    /// @see pp_post_write_bool_async
+    pp_write_token_t pp_post_write_float_async(pp_t pp, float value, pp_write_done_cb_t done_cb, void *context);
+
+    /// @brief Post an asynchronous write event for a string parameter.
+    /// @see pp_post_write_bool_async
+    pp_write_token_t pp_post_write_string_async(pp_t pp, const char *str, pp_write_done_cb_t done_cb, void *context);
+
+    /// @brief Post writes to several parameters as one event.
+    /// All parameters must have the same owner. The owner applies all writes from one event, so no
+    /// other event on the owner loop is handled between them. Writes that are accepted are not
+    /// undone if another write in the batch is rejected.
+    /// @param items The writes, at most MAX_WRITE_BATCH.
+    /// @param count The number of writes.
+    /// @param done_cb Called on the owner event loop when the batch is handled, may be NULL.
+    /// The status is PP_WRITE_REJECTED if any write was rejected.
+    /// @param context The context pointer passed to done_cb.
+    /// @return A token to follow the batch with, or 0 if it could not be posted. done_cb is then not called.
+    pp_write_token_t pp_post_write_batch(const pp_write_item_t *items, size_t count, pp_write_done_cb_t done_cb, void *context);
+
+    /// @brief Get the status of an asynchronous write.
+    /// Results are kept until the slot is needed for a new write, see MAX_PENDING_WRITES in pp.cpp.
+    /// @param token The token returned when the write was posted.
+    /// @param applied If not NULL, set to the value after the write for scalar parameters.
+    /// @return The status of the write.
+    pp_write_status_t pp_get_write_status(pp_write_token_t token, pp_value_t *applied);
+
+    /// @brief Reject the write being handled. Call it from the parameter's write callback.
+    /// @param pp The parameter handle.
+    void pp_write_reject(pp_t pp);
+
     /// @brief Get the parameter's value as string.
     /// @param pp The parameter handle.
     /// @param format The format string. If NULL, the default format is used.
@@ -317,6 +534,25 @@ extern "C"
     /// @return True if the value was successfully converted to a string, false otherwise.
     bool pp_to_json_string(pp_t pp, const char* format, char *buf, size_t *bufsize);
 
+    /// @brief Keep the text and JSON renderings of a parameter, so pp_to_string() and pp_to_json_string()
+    /// copy them while the value and the format do not change. The renderings are invalidated by the
+    /// pp_post_newstate functions, pp_set_valueptr() and changes of the inputs of a derived parameter.
+    /// @attention Values changed through the value pointer without posting a new state are not seen.
+    /// @param pp The parameter handle.
+    /// @param size The size of each rendering, longer renderings are not cached. 0 removes the cache.
+    /// Formats of PP_RENDER_FORMAT_MAX characters or more are not cached.
+    /// @return True if the cache was set, false otherwise.
+    bool pp_set_render_cache(pp_t pp, size_t size);
+
+    /// @brief Get a JSON array of pp_to_json_string() of all parameters with a render cache, in the order
+    /// the caches were set. The document is kept and built again only when one of the parameters changed.
+    /// May be called from any task, concurrent calls copy the same kept document.
+    /// @param format The format string applied to all parameters. If NULL, the default format is used.
+    /// @param buf The buffer to store the document.
+    /// @param bufsize The size of the buffer, set to the length of the document.
+    /// @return True if the document was built, false otherwise.
+    bool pp_get_json_document(const char *format, char *buf, size_t *bufsize);
+
     /// @brief Register an event handler for a specific event loop.
     /// @param evloop The event loop.
     /// @param id The event ID.
@@ -332,12 +568,20 @@ extern "C"
     /// @return True if the event handler was successfully unregistered, false otherwise.
     // bool pp_event_handler_unregister(const pp_evloop_t *evloop, int32_t id, esp_event_handler_t cb);
 
-    /// @brief Register a callback for subscription events.
-    /// @param evloop The event loop.
+    /// @brief Register a callback for changes in demand, called on the owner event loop.
+    /// The callback is called with true when the number of subscribers goes from 0 to 1 or the
+    /// requested rate changes, and with false when it goes from 1 to 0. If the parameter already
+    /// has subscribers the callback is called with true right away.
+    /// @param pp The parameter handle.
     /// @param cb The callback function.
-    /// @param p The context pointer, will contain the pp_t handle.
     /// @return True if the callback was successfully registered, false otherwise.
     bool pp_register_subscribe_cb(const pp_t pp, pp_subscribe_cb_t cb);
+
+    /// @brief Get the current demand for a parameter.
+    /// @param pp The parameter handle.
+    /// @param demand The structure to store the demand in.
+    /// @return True if the demand was returned, false otherwise.
+    bool pp_get_demand(pp_t pp, pp_demand_t *demand);
     // bool pp_event_handler_register_subscribe_cb(const pp_evloop_t *evloop, esp_event_handler_t cb, void *p);
 
     /// @brief Register a callback for unsubscription events.
@@ -354,6 +598,76 @@ extern "C"
     /// @return True if the subscription was successful, false otherwise.
     bool pp_subscribe(pp_t pp, const pp_evloop_t *receiver, esp_event_handler_t event_cb);
 
+    /// @brief Subscribe to a parameter and request an update rate from the producer.
+    /// @param pp The parameter handle.
+    /// @param receiver The event loop to receive updates.
+    /// @param event_cb The callback function for updates.
+    /// @param max_rate_hz The highest update rate this subscriber needs, 0 for no preference.
+    /// @return True if the subscription was successful, false otherwise.
+    bool pp_subscribe_rate(pp_t pp, const pp_evloop_t *receiver, esp_event_handler_t event_cb, uint32_t max_rate_hz);
+
+    /// @brief Subscribe to a parameter with a delivery priority.
+    /// High priority subscriptions, and all subscriptions to high priority parameters, are delivered
+    /// on the fast loop set with pp_set_fast_loop() for the receiver, so they do not queue behind bulk
+    /// updates. Without a fast loop they are delivered on the receiver, but posted first.
+    /// @param pp The parameter handle.
+    /// @param receiver The event loop to receive updates.
+    /// @param event_cb The callback function for updates.
+    /// @param priority The priority of the subscription.
+    /// @return True if the subscription was successful, false otherwise.
+    bool pp_subscribe_priority(pp_t pp, const pp_evloop_t *receiver, esp_event_handler_t event_cb, pp_priority_t priority);
+
+    /// @brief Subscribe to a scalar parameter, receiving only new states that pass a filter.
+    /// The filter is evaluated by the poster, new states that do not pass take no queue space on the
+    /// receiver. The first new state counts as a change for RISING, FALLING and ENTER. Each filtered
+    /// subscription is posted separately. Unsubscribe with pp_unsubscribe().
+    /// Bounds compare exactly with the parameter's values, e.g. ABOVE 2.5 on an int32 passes 3 and
+    /// EQUAL 2.5 passes nothing. NaN bounds are refused and NaN values pass no filter.
+    /// @attention The handler is registered with a private event id of the subscription, not the id
+    /// unfiltered subscribers get. Tell parameters apart by the handler argument, the parameter handle.
+    /// @param pp The parameter handle.
+    /// @param receiver The event loop to receive updates.
+    /// @param event_cb The callback function for updates.
+    /// @param filter The filter, copied.
+    /// @return True if the subscription was successful, false otherwise.
+    bool pp_subscribe_filter(pp_t pp, const pp_evloop_t *receiver, esp_event_handler_t event_cb, const pp_filter_t *filter);
+
+    /// @brief Set the fast loop of a receiving event loop, e.g. a loop with a short queue run by a higher priority task.
+    /// Applies to subscriptions made afterwards, existing subscriptions stay where they are.
+    /// @param receiver The receiving event loop.
+    /// @param fast_loop The fast loop, copied, or NULL to remove it.
+    /// @return True if the fast loop was set, false otherwise.
+    bool pp_set_fast_loop(const pp_evloop_t *receiver, const pp_evloop_t *fast_loop);
+
+    /// @brief Declare the core the task of a receiving event loop is pinned to.
+    /// Applies to the existing subscriptions of the loop as well.
+    /// @param receiver The receiving event loop.
+    /// @param core The core, or -1 if the task is not pinned.
+    /// @return True if the core was set, false otherwise.
+    bool pp_set_loop_core(const pp_evloop_t *receiver, int core);
+
+    /// @brief Set the relay loop of a core, an event loop whose task is pinned to that core.
+    /// A new state for normal priority subscribers on another core than the poster's is posted once to
+    /// that core's relay, which posts it to the subscribers there. The poster then wakes at most one
+    /// task per other core instead of one per receiver. High priority and filtered subscriptions and
+    /// posts from an ISR are not relayed.
+    /// @param core The core.
+    /// @param relay The relay loop, copied, or NULL to remove it.
+    /// @return True if the relay was set, false otherwise.
+    bool pp_set_core_relay(int core, const pp_evloop_t *relay);
+
+    /// @brief Set the priority of a parameter, see pp_subscribe_priority().
+    /// Applies to subscriptions made afterwards, set it right after creating the parameter.
+    /// @param pp The parameter handle.
+    /// @param priority The priority of the parameter.
+    /// @return True if the priority was set, false otherwise.
+    bool pp_set_priority(pp_t pp, pp_priority_t priority);
+
+    /// @brief Get the priority of a parameter.
+    /// @param pp The parameter handle.
+    /// @return The priority of the parameter.
+    pp_priority_t pp_get_priority(pp_t pp);
+
     /// @brief Unsubscribe from a parameter.
     /// @param pp The parameter handle.
     /// @param receiver The event loop to unsubscribe from.
@@ -361,12 +675,55 @@ extern "C"
     /// @return True if the unsubscription was successful, false otherwise.
     bool pp_unsubscribe(pp_t pp, const pp_evloop_t *receiver, esp_event_handler_t event_cb);
 
-    /// @brief Get information about a parameter by index.
-    /// @param index The index of the parameter.
+    /// @brief Subscribe to all parameters matching a name pattern and a type mask.
+    /// Parameters created later that match are subscribed automatically. The callback is
+    /// registered once on the receiver and gets the parameter handle as handler argument.
+    /// @param pattern A parameter name, or a name prefix followed by '*', e.g. "motor.*" or "*".
+    /// @param type The types to match, e.g. TYPE_FLOAT or TYPE_ALL.
+    /// @param receiver The event loop to receive updates.
+    /// @param event_cb The callback function for updates.
+    /// @return A handle to the pattern subscription, or NULL on failure.
+    pp_pattern_t *pp_subscribe_pattern(const char *pattern, parameter_type_t type, const pp_evloop_t *receiver, esp_event_handler_t event_cb);
+
+    /// @brief Remove a pattern subscription.
+    /// @param pattern The pattern subscription handle.
+    /// @return True if the pattern subscription was removed, false otherwise.
+    bool pp_unsubscribe_pattern(pp_pattern_t *pattern);
+
+    /// @brief Get information about the first parameter at or after an index.
+    /// @param index The index of the parameter, see pp_get_par().
     /// @param info The structure to store the parameter information.
-    /// @return The index of the next parameter, or -1 if no more parameters are available.
+    /// @return The index to pass to get the next parameter, or -1 if no more parameters are available.
     int pp_get_info(int index, pp_info_t *info);
 
+    /// @brief Get the next parameter of an iteration over all parameters, in constant time.
+    /// Deleting a parameter moves the last one into its place, an iteration running while
+    /// parameters are deleted may miss the moved one.
+    /// @param cursor The iteration position, start with PP_CURSOR_INIT.
+    /// @param info The structure to store the parameter information, may be NULL.
+    /// @return The parameter handle, or NULL at the end.
+    pp_t pp_get_next(pp_cursor_t *cursor, pp_info_t *info);
+
+    /// @brief Get information about a range of parameters in one call.
+    /// @param start The position of the first parameter, 0 for the first, see pp_get_parameter_count().
+    /// @param info The array to store the parameter information in.
+    /// @param max The size of the array.
+    /// @return The number of parameters stored, less than max at the end.
+    size_t pp_get_info_range(size_t start, pp_info_t *info, size_t max);
+
+    /// @brief Set the metadata of a parameter.
+    /// The pp_post_write functions check the type, the read only flag and the metadata before posting,
+    /// so invalid writes are refused without reaching the owner.
+    /// @param pp The parameter handle.
+    /// @param meta The metadata, copied. The enum values are referenced and must remain valid.
+    /// @return True if the metadata was set, false otherwise.
+    bool pp_set_meta(pp_t pp, const pp_meta_t *meta);
+
+    /// @brief Get the metadata of a parameter.
+    /// @param pp The parameter handle.
+    /// @return The metadata, flags are 0 if none was set.
+    const pp_meta_t *pp_get_meta(pp_t pp);
+
     /// @brief Set a JSON callback for a parameter.
     /// @param pp The parameter handle.
     /// @param cb The JSON callback function.
@@ -390,10 +747,26 @@ extern "C"
     /// @return The context pointer.
     void *pp_get_context(pp_t pp);
 
-    /// @brief Supply malloc, realloc and free functions.
+    /// @brief Supply malloc, realloc and free functions. All allocations of the library go through them.
+    /// Call it before anything is created, memory is freed with the hooks in place at the time.
     /// @param hooks The hooks structure containing the functions.
     void pp_init_hooks(pp_hooks *hooks);
 
+    /// @brief Use a fixed region, e.g. in PSRAM, for the library's allocations of up to PP_ARENA_MAX_BLOCK bytes.
+    /// The region is handed out in 8 byte size classes, freed blocks are reused for the same size class,
+    /// so the containers do not fragment the heap. The parameter table is also placed in the region.
+    /// Larger allocations, and all allocations once the region is full, use the hooks.
+    /// Call it after pp_init_hooks() and before anything is created. The region must remain valid.
+    /// @param region The memory region.
+    /// @param size The size of the region.
+    /// @return True if the arena was set, false otherwise.
+    bool pp_init_arena(void *region, size_t size);
+
+    /// @brief Get the memory used by the library by category, including the peaks.
+    /// @param stats The structure to store the statistics in.
+    /// @return True if the statistics were returned, false otherwise.
+    bool pp_get_memory_stats(pp_memory_stats_t *stats);
+
     /// @brief Get the number of parameters.
     /// @return The number of parameters.
     size_t pp_get_parameter_count(void);
@@ -404,6 +777,31 @@ extern "C"
     /// @attention The user is responsible for freeing the buffer using pp_free().
     bool pp_get_parameter_list_as_json(char **buf, parameter_type_t type);
 
+    /// @brief Get a list of the parameters in a group as JSON.
+    /// @param group The group, e.g. "motor1" for all parameters named "motor1/...". NULL or "" for all.
+    /// @param buf The buffer to store the JSON string.
+    /// @param type The types to include.
+    /// @return True if the JSON string was successfully generated, false otherwise.
+    /// @attention The user is responsible for freeing the buffer using pp_free().
+    bool pp_get_group_list_as_json(const char *group, char **buf, parameter_type_t type);
+
+    /// @brief Get a list of the parameters in a group with their type and metadata as JSON.
+    /// Each parameter is an object, e.g. {"name":"motor1/speed","type":"float","min":0,"max":3000}.
+    /// @param group The group, NULL or "" for all.
+    /// @param buf The buffer to store the JSON string.
+    /// @param type The types to include.
+    /// @return True if the JSON string was successfully generated, false otherwise.
+    /// @attention The user is responsible for freeing the buffer using pp_free().
+    bool pp_get_group_meta_as_json(const char *group, char **buf, parameter_type_t type);
+
+    /// @brief Get the parameters in a group, sorted by name.
+    /// Names are hierarchical with PP_GROUP_SEPARATOR between the levels, e.g. "motor1/speed/feedback".
+    /// @param group The group, e.g. "motor1" or "motor1/speed". NULL or "" for all.
+    /// @param list The array to store the handles in, may be NULL to only count.
+    /// @param max The size of the array.
+    /// @return The number of parameters in the group, may be larger than max.
+    size_t pp_get_group(const char *group, pp_t *list, size_t max);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
\ No newline at end of file
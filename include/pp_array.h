@@ -0,0 +1,69 @@
+#pragma once
+
+#include "pp.h"
+
+#define PP_ARRAY_DEFAULT_KEYFRAME_INTERVAL 32
+/// @brief PP_ARRAY_INT16 code of NaN, other values are clamped to [INT16_MIN + 1, INT16_MAX].
+#define PP_ARRAY_INT16_NAN INT16_MIN
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// @brief How pp_post_newstate_float_array() encodes the arrays of a parameter.
+    typedef enum
+    {
+        PP_ARRAY_RAW = 0, ///< pp_float_array_t, the default.
+        PP_ARRAY_INT16,   ///< Quantized to int16 with a scale and an offset, NaN is kept.
+        PP_ARRAY_SPARSE,  ///< Only the elements that changed since the previous frame, with periodic keyframes.
+    } pp_array_encoding_kind_t;
+
+    /// @brief Encoding of a float array parameter.
+    typedef struct
+    {
+        pp_array_encoding_kind_t kind; ///< The encoding.
+        float scale;                   ///< PP_ARRAY_INT16: value = offset + q * scale, must not be 0.
+        float offset;                  ///< PP_ARRAY_INT16: value = offset + q * scale.
+        float threshold;               ///< PP_ARRAY_SPARSE: elements changing by this much or less are not sent.
+        uint32_t keyframe_interval;    ///< PP_ARRAY_SPARSE: a full frame every n frames, 0 for the default.
+    } pp_array_encoding_t;
+
+    /// @brief Header of an encoded frame, the new state of a parameter with an encoding.
+    /// PP_ARRAY_INT16 frames have count int16_t values. PP_ARRAY_SPARSE keyframes have count floats,
+    /// other sparse frames have count uint16_t indices, padded to 4 bytes, then count floats.
+    typedef struct
+    {
+        uint8_t kind;      ///< pp_array_encoding_kind_t of the frame.
+        uint8_t keyframe;  ///< 1 if the frame holds the whole array.
+        uint16_t count;    ///< Number of values in the frame.
+        uint32_t sequence; ///< Frame number, incremented by each frame, starting at 1.
+        uint32_t len;      ///< Length of the array.
+        float scale;       ///< PP_ARRAY_INT16 scale.
+        float offset;      ///< PP_ARRAY_INT16 offset.
+    } pp_array_frame_t;
+
+    /// @brief Set the encoding of a float array parameter. Subscribers then get a pp_array_frame_t
+    /// instead of a pp_float_array_t, decode it with pp_array_decode().
+    /// @param pp The parameter handle, a float array parameter.
+    /// @param encoding The encoding, copied, or NULL for PP_ARRAY_RAW.
+    /// @return True if the encoding was set, false if it is invalid or pp_bridge_export() exports the parameter.
+    bool pp_set_array_encoding(pp_t pp, const pp_array_encoding_t *encoding);
+
+    /// @brief Get the encoding of a float array parameter.
+    /// @param pp The parameter handle.
+    /// @return The encoding, PP_ARRAY_RAW if none was set.
+    pp_array_encoding_kind_t pp_get_array_encoding(pp_t pp);
+
+    /// @brief Decode a frame into a float array. Sparse frames are applied to the previous frame in
+    /// the array, a missed frame is detected by its sequence number and decoding waits for the next keyframe.
+    /// @param frame The event data of the new state.
+    /// @param out The decoded array, keep it between the frames of a sparse parameter.
+    /// @param capacity The number of floats out can hold, see pp_allocate_float_array().
+    /// @param sequence The sequence number of the frame in out, 0 at first. Updated when the frame is decoded.
+    /// @return True if out holds the frame, false if a keyframe is needed or the frame does not fit.
+    bool pp_array_decode(const pp_array_frame_t *frame, pp_float_array_t *out, size_t capacity, uint32_t *sequence);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
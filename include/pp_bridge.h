@@ -0,0 +1,69 @@
+#pragma once
+
+#include "pp.h"
+
+#define PP_BRIDGE_MAX_FRAME 1024
+#define PP_BRIDGE_BUFFER_SIZE 4096
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// @brief Byte stream the bridge runs over, e.g. a UART, a TCP socket or a socketpair.
+    typedef struct pp_bridge_transport_t
+    {
+        void *ctx; ///< Transport context, passed to the functions.
+        /// @brief Write up to size bytes without blocking.
+        /// @return The number of bytes written, 0 if the transport is full, negative on error.
+        int (*write)(void *ctx, const void *buf, size_t size);
+        /// @brief Read up to size bytes without blocking.
+        /// @return The number of bytes read, 0 if nothing is available, negative on error.
+        int (*read)(void *ctx, void *buf, size_t size);
+    } pp_bridge_transport_t;
+
+    typedef struct pp_bridge_t pp_bridge_t; ///< Opaque handle to a bridge.
+
+    /// @brief Create a bridge mirroring parameters to a remote node over a transport.
+    /// Parameters exported on one side appear as proxy parameters on the other side. Proxies get a
+    /// new state when the exported parameter changes, and writes to a proxy are posted to the
+    /// exported parameter with pp_post_write_*.
+    /// @param transport The transport, copied.
+    /// @param evloop The event loop used for the bridge's subscriptions and as owner of the proxies.
+    /// @param proxy_prefix Prepended to the names of proxies created from the remote, e.g. "node2/". May be NULL.
+    /// @return A handle to the bridge, or NULL on failure.
+    pp_bridge_t *pp_bridge_create(const pp_bridge_transport_t *transport, const pp_evloop_t *evloop, const char *proxy_prefix);
+
+    /// @brief Delete a bridge, its subscriptions and its proxy parameters.
+    /// @param bridge The bridge handle.
+    void pp_bridge_delete(pp_bridge_t *bridge);
+
+    /// @brief Mirror a parameter to the remote node.
+    /// Only changes are sent, and all changes since the last poll are sent in one frame.
+    /// @param bridge The bridge handle.
+    /// @param pp The parameter handle. Binary parameters are not supported, their size is not known to subscribers.
+    /// Float arrays with an encoding are not supported either, and can not be given one while exported.
+    /// @return True if the parameter was exported, false otherwise.
+    bool pp_bridge_export(pp_bridge_t *bridge, pp_t pp);
+
+    /// @brief Send pending changes and handle received frames.
+    /// Call it periodically from the task running the bridge's event loop, e.g. from a timer event on that loop.
+    /// When the transport is full, changes are held back and only the latest value of each parameter is sent.
+    /// @param bridge The bridge handle.
+    /// @return False if the transport reported an error.
+    bool pp_bridge_poll(pp_bridge_t *bridge);
+
+    /// @brief Describe all exported parameters and send their values again, e.g. after the remote restarted.
+    /// @param bridge The bridge handle.
+    void pp_bridge_announce(pp_bridge_t *bridge);
+
+    /// @brief Fill in a transport using a file descriptor, e.g. a socket or a UART opened through the VFS.
+    /// The descriptor is set to non blocking.
+    /// @param transport The transport to fill in.
+    /// @param fd The file descriptor.
+    /// @return True if the transport was filled in.
+    bool pp_bridge_fd_transport(pp_bridge_transport_t *transport, int fd);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
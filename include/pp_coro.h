@@ -0,0 +1,193 @@
+#pragma once
+
+// Awaiting parameter changes from C++20 coroutines, built on pp_subscribe(). Available when the
+// compiler supports coroutines, e.g. with -std=gnu++20.
+
+#ifdef __cplusplus
+
+#include <type_traits>
+#include <stdlib.h>
+#include <string.h>
+#include "pp.h"
+
+namespace pp
+{
+    namespace detail
+    {
+        struct subscription;
+
+        /// @brief A suspended coroutine, part of its awaiter.
+        struct waiter
+        {
+            subscription *sub;
+            /// @brief Takes the new state and returns true if the coroutine is to be resumed.
+            bool (*check)(waiter *w, const void *data);
+            /// @brief Resumes the coroutine, called on the receiver.
+            void (*resume)(waiter *w);
+            waiter *next;
+        };
+
+        /// @brief True if the parameter has the type, logged otherwise.
+        bool type_matches(pp_t pp, parameter_type_t type);
+
+        /// @brief Add a waiter, subscribing on the receiver if it is the first one there. Receivers
+        /// waiting on the same parameter need distinct bases, the handler only gets the base.
+        /// @return False if the type does not match or the subscription failed, w is then not added.
+        bool add(waiter *w, pp_t pp, const pp_evloop_t *receiver, parameter_type_t type);
+    } // namespace detail
+} // namespace pp
+
+#endif // __cplusplus
+
+#if defined(__cplusplus) && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+
+namespace pp
+{
+    /// @brief Return type of a coroutine that starts right away and frees itself when it returns.
+    /// Nothing waits for it, like a task that is not joined.
+    struct task
+    {
+        struct promise_type
+        {
+            task get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { abort(); }
+        };
+    };
+
+    namespace detail
+    {
+        /// @brief A waiter that resumes a coroutine handle.
+        struct coro_waiter : waiter
+        {
+            std::coroutine_handle<> handle;
+
+            static void resume_handle(waiter *w) { static_cast<coro_waiter *>(w)->handle.resume(); }
+        };
+
+        template <typename T>
+        inline constexpr bool is_scalar = std::is_same_v<T, int32_t> || std::is_same_v<T, int64_t> || std::is_same_v<T, float> || std::is_same_v<T, bool>;
+
+        template <typename T>
+        inline constexpr parameter_type_t type_of = std::is_same_v<T, int32_t>   ? TYPE_INT32
+                                                    : std::is_same_v<T, int64_t> ? TYPE_INT64
+                                                    : std::is_same_v<T, float>   ? TYPE_FLOAT
+                                                                                 : TYPE_BOOL;
+    } // namespace detail
+
+    /// @brief A scalar parameter that coroutines can wait on, e.g. co_await speed.next().
+    /// Waiting subscribes on the receiver and the coroutine continues on the receiver's task, so
+    /// many coroutines can share one event loop without a task each. The subscription is removed
+    /// when no coroutine waits on it anymore.
+    /// A parameter of another type than T is not awaited, co_await then returns T() right away.
+    /// @tparam T The value type: int32_t, int64_t, float or bool, matching the parameter type.
+    template <typename T>
+    class param
+    {
+        static_assert(detail::is_scalar<T>, "pp::param is for int32_t, int64_t, float and bool parameters");
+
+    public:
+        /// @param pp The parameter handle, of the type T.
+        /// @param receiver The event loop the waiting coroutines continue on.
+        param(pp_t pp, const pp_evloop_t *receiver) : pp_(pp), receiver_(*receiver), valid_(detail::type_matches(pp, detail::type_of<T>)) {}
+
+        /// @brief Awaiter of the next new state, co_await returns its value.
+        struct next_awaiter : detail::coro_waiter
+        {
+            pp_t pp;
+            pp_evloop_t receiver;
+            T value;
+
+            bool await_ready() const noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> h)
+            {
+                handle = h;
+                check = &next_awaiter::take;
+                resume = &detail::coro_waiter::resume_handle;
+                // Not suspended if the subscription failed, the value is then the current one
+                if (detail::add(this, pp, &receiver, detail::type_of<T>))
+                    return true;
+                read(pp, &value);
+                return false;
+            }
+            T await_resume() const noexcept { return value; }
+
+            static bool take(detail::waiter *w, const void *data)
+            {
+                memcpy(&static_cast<next_awaiter *>(w)->value, data, sizeof(T));
+                return true;
+            }
+        };
+
+        /// @brief Awaiter of a value that satisfies a predicate, co_await returns the value.
+        template <typename Pred>
+        struct until_awaiter : detail::coro_waiter
+        {
+            pp_t pp;
+            pp_evloop_t receiver;
+            Pred pred;
+            T value;
+
+            /// @brief Not suspended if the current value already satisfies the predicate.
+            bool await_ready() { return read(pp, &value) && pred(value); }
+            bool await_suspend(std::coroutine_handle<> h)
+            {
+                handle = h;
+                check = &until_awaiter::test;
+                resume = &detail::coro_waiter::resume_handle;
+                return detail::add(this, pp, &receiver, detail::type_of<T>);
+            }
+            T await_resume() const noexcept { return value; }
+
+            static bool test(detail::waiter *w, const void *data)
+            {
+                until_awaiter *self = static_cast<until_awaiter *>(w);
+                memcpy(&self->value, data, sizeof(T));
+                return self->pred(self->value);
+            }
+        };
+
+        /// @brief Wait for the next new state.
+        next_awaiter next() const { return next_awaiter{{}, pp_, receiver_, T()}; }
+
+        /// @brief Wait until a value satisfies pred, which is called on the receiver with each new state.
+        /// @param pred Callable taking a T and returning bool, copied into the awaiter.
+        template <typename Pred>
+        until_awaiter<Pred> until(Pred pred) const { return until_awaiter<Pred>{{}, pp_, receiver_, pred, T()}; }
+
+        /// @brief The current value, read through the value pointer. T() if there is none.
+        T value() const
+        {
+            T v = T();
+            read(pp_, &v);
+            return v;
+        }
+
+        pp_t handle() const { return pp_; }
+
+        /// @brief False if the parameter does not have the type T.
+        bool valid() const { return valid_; }
+
+    private:
+        static bool read(pp_t pp, T *v)
+        {
+            if ((pp_get_type(pp) & TYPE_ALL) != detail::type_of<T>)
+                return false;
+            const void *valueptr = pp_get_valueptr(pp);
+            if (valueptr == NULL)
+                return false;
+            memcpy(v, valueptr, sizeof(T));
+            return true;
+        }
+
+        pp_t pp_;
+        pp_evloop_t receiver_;
+        bool valid_;
+    };
+} // namespace pp
+
+#endif // __cpp_impl_coroutine
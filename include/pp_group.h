@@ -0,0 +1,51 @@
+#pragma once
+
+#include "pp.h"
+
+#define PP_GROUP_MAX_MEMBERS 16
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// @brief Consistent values of all members of a group, also the new state of the group parameter.
+    typedef struct
+    {
+        uint32_t version;                         ///< Incremented by each commit, 0 before the first.
+        uint32_t count;                           ///< Number of members.
+        pp_value_t values[PP_GROUP_MAX_MEMBERS]; ///< Member values, in the order given to pp_group_create().
+    } pp_group_snapshot_t;
+
+    /// @brief Create a group of scalar parameters that are published together.
+    /// The group is a binary parameter, its subscribers get a pp_group_snapshot_t with the values of
+    /// all members for each commit, instead of one event per member.
+    /// @param name The name of the group parameter.
+    /// @param owner The event loop owning the group, usually the owner of the members.
+    /// @param members The member parameters, scalar types only.
+    /// @param count The number of members, at most PP_GROUP_MAX_MEMBERS.
+    /// @return The handle of the group parameter, or NULL on failure.
+    pp_t pp_group_create(const char *name, const pp_evloop_t *owner, const pp_t *members, size_t count);
+
+    /// @brief Delete a group and its group parameter. The members are not deleted. Commits and
+    /// snapshots running on other tasks finish on the deleted group, later ones return false.
+    /// @param group The group parameter handle.
+    /// @return True if the group was deleted.
+    bool pp_group_delete(pp_t group);
+
+    /// @brief Publish the current values of all members as one new version.
+    /// Update the members' values first, then commit. Readers of pp_group_snapshot() see either all
+    /// values of a commit or all values of the previous one. One new state is posted on the group parameter.
+    /// @param group The group parameter handle.
+    /// @return True if the snapshot was taken and posted to all subscribers.
+    bool pp_group_commit(pp_t group);
+
+    /// @brief Get the values of the last commit without locking, from any task.
+    /// @param group The group parameter handle.
+    /// @param snapshot Set to the values of the last commit.
+    /// @return True if the snapshot was copied.
+    bool pp_group_snapshot(pp_t group, pp_group_snapshot_t *snapshot);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
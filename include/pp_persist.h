@@ -0,0 +1,71 @@
+#pragma once
+
+#include "pp.h"
+
+#define PP_PERSIST_DEFAULT_DELAY_MS 2000
+#define PP_PERSIST_NVS_NAMESPACE "pp"
+#define PP_PERSIST_TASK_STACK_SIZE 3072
+#define PP_PERSIST_TASK_PRIORITY 1
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// @brief Storage backend for persistent parameters. All parameters are stored as one record.
+    typedef struct pp_persist_backend_t
+    {
+        void *ctx; ///< Backend context, passed to the functions.
+        /// @brief Read the stored record.
+        /// If buf is NULL, *size is set to the size of the stored record.
+        /// @return False if there is no stored record or it could not be read.
+        bool (*load)(void *ctx, void *buf, size_t *size);
+        /// @brief Replace the stored record.
+        /// @return True if the record was written.
+        bool (*store)(void *ctx, const void *buf, size_t size);
+    } pp_persist_backend_t;
+
+    /// @brief Initialize the persistence layer and read the stored record in one bulk read.
+    /// Call this at boot before parameters are attached and before subscribers start.
+    /// Delayed writes run on a task of their own, the "pp_persist" event loop, never on the esp_timer task.
+    /// @param backend The storage backend, copied.
+    /// @param delay_ms Writes are coalesced for this long after the first change.
+    /// @return True if initialized, a missing record is not an error.
+    bool pp_persist_init(const pp_persist_backend_t *backend, uint32_t delay_ms);
+
+    /// @brief Persist a parameter. The stored value, if any, is restored into the value pointer.
+    /// @param pp The parameter handle, must have a value pointer.
+    /// @param size The size of the value, or 0 to use the size of the parameter type.
+    /// Strings and binaries need the size of the buffer behind the value pointer.
+    /// @return True if the parameter was attached.
+    bool pp_persist_attach(pp_t pp, size_t size);
+
+    /// @brief Stop persisting a parameter. The stored value is kept.
+    /// @param pp The parameter handle.
+    /// @return True if the parameter was detached.
+    bool pp_persist_detach(pp_t pp);
+
+    /// @brief Mark a persistent parameter as changed and schedule a write.
+    /// Called by the pp_post_newstate functions, call it directly for values changed without posting.
+    /// @param pp The parameter handle.
+    void pp_persist_mark_dirty(pp_t pp);
+
+    /// @brief Write all persistent parameters now if any has changed.
+    /// @return True if nothing needed writing or the record was written.
+    bool pp_persist_flush(void);
+
+    /// @brief Fill in a backend storing the record as an NVS blob in PP_PERSIST_NVS_NAMESPACE.
+    /// @param backend The backend to fill in.
+    /// @param key The NVS key, must remain valid.
+    /// @return True if the backend was filled in.
+    bool pp_persist_nvs_backend(pp_persist_backend_t *backend, const char *key);
+
+    /// @brief Fill in a backend storing the record in a file, replaced atomically on each write.
+    /// @param backend The backend to fill in.
+    /// @param path The file path, must remain valid.
+    /// @return True if the backend was filled in.
+    bool pp_persist_file_backend(pp_persist_backend_t *backend, const char *path);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
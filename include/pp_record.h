@@ -0,0 +1,53 @@
+#pragma once
+
+#include "pp.h"
+
+#define PP_RECORD_MAGIC 0x31525050 // "PPR1"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// @brief Result of a replay.
+    typedef struct
+    {
+        uint32_t posts;       ///< New states posted.
+        uint32_t failed;      ///< Posts that returned false, e.g. no subscribers or a full queue.
+        uint32_t skipped;     ///< Entries of parameters that do not exist or have another type.
+        uint64_t duration_us; ///< Time the replay took.
+        uint32_t max_lag_us;  ///< Largest delay of a post behind its scheduled time.
+        float rate_hz;        ///< Posts per second.
+    } pp_replay_stats_t;
+
+    /// @brief Start recording the new states posted with the pp_post_newstate functions.
+    /// Any previous recording is discarded. Recording stops when the buffer is full.
+    /// @param size The size of the recording buffer in bytes.
+    /// @return True if recording started.
+    bool pp_record_start(size_t size);
+
+    /// @brief Stop recording. The recording is kept until the next pp_record_start().
+    void pp_record_stop(void);
+
+    /// @brief Copy the recording into a buffer. Recording pauses during the copy.
+    /// The dump is a header {magic, version, entry count, parameter count, dropped entries, entry bytes}
+    /// of uint32_t, the parameters as [u16 index][u16 type][u8 len][name] padded to 4 bytes, then
+    /// the entries as {u64 time in us since the start, u16 index, u16 0, u32 size} followed by the
+    /// value padded to 4 bytes. Float arrays are recorded as their floats.
+    /// @param buf The buffer, or NULL to get the size needed.
+    /// @param size The size of the buffer, set to the size of the dump.
+    /// @return True if the dump was copied, false if the buffer is too small or nothing was recorded.
+    bool pp_record_dump(void *buf, size_t *size);
+
+    /// @brief Post the new states of a dump again through the pp_post_newstate functions, e.g. on a
+    /// bench or a Linux host. Parameters are found by name. Blocks until the replay is done.
+    /// @param dump The dump from pp_record_dump().
+    /// @param size The size of the dump.
+    /// @param speed 1 for the recorded timing, 2 for twice as fast, 0 to post as fast as possible.
+    /// @param stats Set to the result of the replay, may be NULL.
+    /// @return True if the dump was replayed, false if it is not valid.
+    bool pp_replay(const void *dump, size_t size, float speed, pp_replay_stats_t *stats);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,38 @@
+#pragma once
+
+#include "pp.h"
+
+#define PP_SAMPLE_DEFAULT_TICK_MS 10
+#define PP_SAMPLE_MAX_PARAMETERS 32
+#define PP_SAMPLE_TASK_STACK_SIZE 3072
+#define PP_SAMPLE_TASK_PRIORITY 5
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// @brief Start the sampling scheduler, one periodic esp_timer for all sampled parameters.
+    /// The timer only signals the "pp_sample" event loop task, which reads and posts the parameters.
+    /// A tick that arrives while the task is still behind by two ticks is skipped.
+    /// @param tick_ms The scheduler period. Sampling periods are rounded up to a multiple of it.
+    /// @return True if the scheduler started.
+    bool pp_sample_init(uint32_t tick_ms);
+
+    /// @brief Publish a parameter by reading its value pointer periodically.
+    /// Parameters with the same period are sampled in the same tick and posted one after the other,
+    /// periods that are multiples of each other line up. Parameters without subscribers are not read.
+    /// @param pp The parameter handle, a scalar type with a value pointer.
+    /// @param period_ms The sampling period.
+    /// @param on_change True to post only values that differ from the last posted value.
+    /// @return True if the parameter is sampled, an attached parameter gets the new period.
+    bool pp_sample_attach(pp_t pp, uint32_t period_ms, bool on_change);
+
+    /// @brief Stop sampling a parameter. Deleted parameters are detached on the next tick.
+    /// @param pp The parameter handle.
+    /// @return True if the parameter was sampled.
+    bool pp_sample_detach(pp_t pp);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "pp.h"
+
+#define PP_TRACE_MAGIC 0x31545050 // "PPT1"
+#define PP_TRACE_MAX_RECEIVERS 16
+#define PP_TRACE_NO_PARAM 0xFFFF
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    /// @brief What a trace entry records.
+    typedef enum
+    {
+        PP_TRACE_NEWSTATE = 1,     ///< New state posted to one receiver.
+        PP_TRACE_NEWSTATE_IRQ,     ///< New state posted to one receiver from an ISR.
+        PP_TRACE_WRITE,            ///< Write posted to the owner.
+        PP_TRACE_WRITE_BATCH,      ///< Batch write posted to the owner, param is the first item.
+    } pp_trace_kind_t;
+
+    /// @brief One post in the trace, 16 bytes, little endian in the dump.
+    typedef struct
+    {
+        uint32_t timestamp_us; ///< Start of the post, low 32 bits of esp_timer_get_time().
+        uint32_t duration_us;  ///< Time spent in the post, includes waiting on a full queue.
+        uint16_t param;        ///< Parameter index, see pp_get_par(), or PP_TRACE_NO_PARAM.
+        uint16_t size;         ///< Payload size in bytes.
+        uint8_t kind;          ///< One of pp_trace_kind_t.
+        uint8_t receiver;      ///< Index in the receiver table of the dump.
+        uint8_t result;        ///< 0 if posted, 1 if the post failed.
+        uint8_t core;          ///< Core the post was made on.
+    } pp_trace_entry_t;
+
+    /// @brief Start recording posts into a ring, the oldest entries are overwritten.
+    /// Any previous trace is discarded.
+    /// @param entries The number of entries in the ring.
+    /// @return True if recording started, false if allocation failed or pp_trace_dump() is running.
+    bool pp_trace_start(size_t entries);
+
+    /// @brief Stop recording. The trace is kept until the next pp_trace_start().
+    void pp_trace_stop(void);
+
+    /// @brief Copy the trace into a buffer, oldest entry first. Recording pauses during the copy.
+    /// The dump is a header {magic, version, entry count, receiver count, parameter count} of
+    /// uint32_t, the receiver names as [u8 len][name], the parameter names as [u16 index][u8 len][name],
+    /// then the entries. tools/pp_trace2json.py converts it to Chrome trace JSON.
+    /// @param buf The buffer, or NULL to get the size needed.
+    /// @param size The size of the buffer, set to the size of the dump.
+    /// @return True if the dump was copied, false if the buffer is too small or nothing was recorded.
+    bool pp_trace_dump(void *buf, size_t *size);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
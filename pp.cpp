@@ -2,18 +2,92 @@
 #include <string.h>
 #include <map>
 #include <list>
+#include <float.h>
+#include <math.h>
 #include <esp_log.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "sdkconfig.h"
 #include "pp.h"
+#include "esp_timer.h"
+#include "pp_persist.h"
+#include "pp_trace.h"
+#include "pp_internal.h"
 #include "esp_debug_helpers.h"
 
 #define MAX_PUBLIC_PARAMETERS 55
 #define ID_SUBSCRIBE 1000
 #define ID_UNSUBSCRIBE 1001
-#define ID_COUNTER_START 1002
+#define ID_WRITE_BATCH 1002
+#define ID_RELAY 1003
+#define ID_COUNTER_START 1010
 #define POST_WAIT_MS 10
+#define WRITE_TOKEN_SLOT_BITS 4
+#define MAX_PENDING_WRITES (1 << WRITE_TOKEN_SLOT_BITS)
+#define ARENA_ALIGN 8
+#define HANDLE_INDEX_BITS 10
+#define HANDLE_INDEX_MASK ((1 << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_GENERATION_MAX (UINTPTR_MAX >> HANDLE_INDEX_BITS)
+#define ARENA_CLASSES (PP_ARENA_MAX_BLOCK / ARENA_ALIGN)
+
+/// @brief Identifies a receiver: receivers on the default loop differ only by their base.
+typedef std::pair<esp_event_loop_handle_t, esp_event_base_t> pp_receiver_key_t;
+
+/// @brief A handler subscribed to a parameter on a receiving event loop.
+typedef struct
+{
+    esp_event_handler_t event_cb;
+    esp_event_handler_instance_t instance;
+    /// @brief The receiver passed to subscribe, the handler is registered on its fast loop for high priority.
+    pp_receiver_key_t receiver;
+    /// @brief Highest update rate the subscriber wants, 0 if it has no preference.
+    uint32_t max_rate_hz;
+} pp_subscriber_t;
+
+/// @brief All handlers subscribed to a parameter on one event loop, they share one post.
+typedef struct
+{
+    pp_evloop_t evloop;
+    std::list<pp_subscriber_t, pp_allocator<pp_subscriber_t, PP_MEM_SUBSCRIPTIONS>> subscribers;
+    /// @brief True for high priority subscriptions, posted before the others.
+    bool fast;
+    /// @brief Core the receiver's task is pinned to, see pp_set_loop_core(), or -1 if unknown.
+    int core;
+} pp_subscription_t;
+
+/// @brief A subscriber with a filter, posted on its own event id when the filter passes.
+typedef struct
+{
+    pp_evloop_t evloop;
+    /// @brief The receiver passed to subscribe, evloop may be its fast loop.
+    pp_receiver_key_t receiver;
+    esp_event_handler_t event_cb;
+    esp_event_handler_instance_t instance;
+    int32_t event_id;
+    bool fast;
+    pp_filter_kind_t kind;
+    /// @brief Keys of the parameter type that meet the condition, see pp_filter_key(). Empty if low > high.
+    int64_t low;
+    int64_t high;
+    uint64_t mask;
+    /// @brief True if the last value met the condition, for the edge filters.
+    bool inside;
+} pp_filtered_t;
+
+/// @brief Renderings kept by pp_set_render_cache(), followed by the text and the JSON buffer.
+typedef struct
+{
+    /// @brief Size of each buffer.
+    size_t size;
+    /// @brief Format the renderings were made with, unused if has_format is false.
+    char format[PP_RENDER_FORMAT_MAX];
+    bool has_format;
+    /// @brief Text and JSON rendering, valid if state.changes did not change since it was rendered.
+    bool valid[2];
+    uint32_t rendered[2];
+    size_t len[2];
+} pp_render_cache_t;
 
 typedef struct public_parameter_t
 {
@@ -24,31 +98,209 @@ typedef struct public_parameter_t
         const pp_evloop_t *owner;
         pp_json_cb_t json_cb;
         parameter_type_t type;
+        pp_priority_t priority;
+        /// @brief Checked by the pp_post_write functions before the write is posted.
+        pp_meta_t meta;
+        /// @brief Set for derived parameters, computed from the inputs.
+        struct
+        {
+            pp_derive_cb_t cb;
+            void *context;
+            pp_t inputs[MAX_DERIVED_INPUTS];
+            size_t input_count;
+            /// @brief Longest path to a non derived input, used to order recomputation.
+            int rank;
+        } derive;
     } conf;
 
     // State part
     struct
     {
-        std::map<esp_event_loop_handle_t, pp_evloop_t> subscription_list;
+        std::map<pp_receiver_key_t, pp_subscription_t, std::less<pp_receiver_key_t>,
+                 pp_allocator<std::pair<const pp_receiver_key_t, pp_subscription_t>, PP_MEM_SUBSCRIPTIONS>>
+            subscription_list;
+        /// @brief Subscribers with a filter, not part of subscription_list.
+        std::list<pp_filtered_t, pp_allocator<pp_filtered_t, PP_MEM_SUBSCRIPTIONS>> filtered;
+        /// @brief Number of subscribers on all event loops.
+        size_t subscribers;
+        uint32_t max_rate_hz;
         pp_subscribe_cb_t subscribe_cb;
+        esp_event_handler_t write_cb;
+        esp_event_handler_instance_t write_instance;
+        /// @brief Set by pp_write_reject() from the write callback.
+        bool write_rejected;
         int32_t newstate_id;
         int32_t write_id;
         /// @brief True if the parameter is active, false if it is inactive.
         bool is_active;
+        /// @brief Position in live_list.
+        size_t live_index;
+        /// @brief Incremented when the parameter is deleted, handles of the old parameter no longer resolve.
+        uint32_t generation;
+        /// @brief True if new states are reported to the persistence layer.
+        bool persistent;
         const void *valueptr;
         void *context;
+        /// @brief Derived parameters that use this parameter as input.
+        std::list<public_parameter_t *, pp_allocator<public_parameter_t *, PP_MEM_DERIVED>> dependents;
+        /// @brief True if a derived value must be recomputed before it is read.
+        bool derived_dirty;
+        float derived_value;
+        /// @brief Incremented when the value changes, checked by the render cache.
+        volatile uint32_t changes;
+        pp_render_cache_t *render_cache;
+        /// @brief Set for float arrays posted encoded, see pp_set_array_encoding(). Guarded by array_lock.
+        pp_array_encoder_t *array_encoder;
+        /// @brief Number of bridge exports, an exported parameter can not be encoded. Guarded by array_lock.
+        uint8_t bridge_exports;
     } state;
 
-    bool operator==(const pp_t& other) const {
-        return state.newstate_id == other->state.newstate_id;
-    }
-
 } public_parameter_t;
 
-static public_parameter_t par_list[MAX_PUBLIC_PARAMETERS];
-static std::map<std::string, public_parameter_t *> nameToPP;
+/// @brief A subscription to all parameters matching a name pattern and a type mask.
+typedef struct pp_pattern_t
+{
+    pp_string<PP_MEM_PATTERNS> prefix;
+    /// @brief True if the pattern ends with '*' and matches all names starting with prefix.
+    bool wildcard;
+    parameter_type_t type;
+    pp_evloop_t receiver;
+    esp_event_handler_t event_cb;
+    esp_event_handler_instance_t instance;
+    /// @brief Matched parameters by their newstate event id.
+    std::map<int32_t, public_parameter_t *, std::less<int32_t>,
+             pp_allocator<std::pair<const int32_t, public_parameter_t *>, PP_MEM_PATTERNS>>
+        matched;
+} pp_pattern_t;
+
+/// @brief Orders names by content. Names are referenced, not copied, like conf.name.
+struct pp_name_less
+{
+    bool operator()(const char *a, const char *b) const { return strcmp(a, b) < 0; }
+};
+typedef std::map<const char *, public_parameter_t *, pp_name_less,
+                 pp_allocator<std::pair<const char *const, public_parameter_t *>, PP_MEM_NAMES>>
+    pp_name_map_t;
+
+/// @brief The parameter table, allocated through the hooks or the arena when the first parameter is created.
+static public_parameter_t *par_list = NULL;
+/// @brief The created parameters, packed, for enumeration in constant time per parameter.
+static public_parameter_t **live_list = NULL;
+static size_t live_count = 0;
+
+static_assert(MAX_PUBLIC_PARAMETERS <= HANDLE_INDEX_MASK, "Parameter index does not fit in a handle");
+static_assert(MAX_PUBLIC_PARAMETERS <= 64, "Derived invalidation keeps a bit per parameter");
+
+/// @brief Get the handle of a parameter, its table index and the generation of its slot.
+static pp_t pp_handle(const public_parameter_t *p)
+{
+    if (p == NULL)
+        return NULL;
+    return (pp_t)(((uintptr_t)p->state.generation << HANDLE_INDEX_BITS) | (uintptr_t)(p - par_list));
+}
+
+/// @brief Get the parameter of a handle.
+/// @return The parameter, or NULL if the handle is NULL or the parameter was deleted.
+static public_parameter_t *pp_resolve(pp_t pp)
+{
+    uintptr_t handle = (uintptr_t)pp;
+    size_t index = handle & HANDLE_INDEX_MASK;
+    if (handle == 0 || par_list == NULL || index >= MAX_PUBLIC_PARAMETERS)
+        return NULL;
+    public_parameter_t *p = &par_list[index];
+    if (p->state.generation != (handle >> HANDLE_INDEX_BITS) || p->conf.name == NULL)
+        return NULL;
+    return p;
+}
+static pp_name_map_t nameToPP;
+/// @brief Header in front of the value in write events.
+typedef struct
+{
+    pp_write_token_t token;
+    uint32_t size;
+} pp_write_header_t;
+/// @brief Header in front of the receivers and the value in relay events.
+typedef struct
+{
+    pp_t pp;
+    uint32_t size;  ///< Size of the value.
+    uint32_t count; ///< Number of receivers, the pp_evloop_t after the header.
+} pp_relay_header_t;
+
+/// @brief One write in a batch event, resolved again on the owner loop.
+typedef struct
+{
+    pp_t pp;
+    pp_value_t value;
+} pp_write_batch_item_t;
+
+/// @brief Completion state of an asynchronous write, tokens hold the slot index in the low bits.
+typedef struct
+{
+    pp_write_token_t token;
+    pp_write_status_t status;
+    pp_value_t applied;
+    pp_write_done_cb_t done_cb;
+    void *context;
+} pp_write_slot_t;
+
+static std::list<pp_pattern_t, pp_allocator<pp_pattern_t, PP_MEM_PATTERNS>> pattern_list;
+/// @brief Fast loops by the receiving event loop, see pp_set_fast_loop().
+static std::map<esp_event_loop_handle_t, pp_evloop_t, std::less<esp_event_loop_handle_t>,
+                pp_allocator<std::pair<const esp_event_loop_handle_t, pp_evloop_t>, PP_MEM_SUBSCRIPTIONS>>
+    fast_loops;
+/// @brief Cores of receiving event loops, see pp_set_loop_core().
+static std::map<esp_event_loop_handle_t, int, std::less<esp_event_loop_handle_t>,
+                pp_allocator<std::pair<const esp_event_loop_handle_t, int>, PP_MEM_SUBSCRIPTIONS>>
+    loop_cores;
+/// @brief Relay loop of each core, see pp_set_core_relay().
+static struct
+{
+    bool set;
+    pp_evloop_t evloop;
+    esp_event_handler_instance_t instance;
+} core_relays[portNUM_PROCESSORS];
+/// @brief Owner event loops with the library's owner handlers registered.
+static std::list<pp_evloop_t, pp_allocator<pp_evloop_t, PP_MEM_SUBSCRIPTIONS>> owner_loops;
+static pp_write_slot_t write_slots[MAX_PENDING_WRITES];
+static uint32_t write_token_counter = 0;
+static portMUX_TYPE write_lock = portMUX_INITIALIZER_UNLOCKED;
 static int32_t event_id_counter = ID_COUNTER_START;
 static pp_hooks hooks = {malloc, calloc, free};
+static pp_memory_stats_t memory_stats;
+static portMUX_TYPE memory_lock = portMUX_INITIALIZER_UNLOCKED;
+/// @brief Optional region for small allocations, see pp_init_arena().
+static struct
+{
+    uint8_t *base;
+    size_t size;
+    size_t used;
+    /// @brief Freed blocks by size class, reused before the region is bumped.
+    void *free_list[ARENA_CLASSES];
+} arena;
+
+/// @brief Parameters with a render cache, in the order of the cached document.
+static std::list<public_parameter_t *, pp_allocator<public_parameter_t *, PP_MEM_CACHE>> render_list;
+/// @brief Incremented when a parameter in render_list changes or the list changes.
+static volatile uint32_t render_changes = 0;
+/// @brief Document built by pp_get_json_document(), followed by the text. Readers copy it
+/// outside render_lock while holding a reference, the last reference frees it.
+typedef struct
+{
+    uint32_t refs;
+    size_t len;
+    uint32_t rendered;
+    char format[PP_RENDER_FORMAT_MAX];
+    bool has_format;
+} pp_render_doc_t;
+/// @brief The cached document, holds one reference.
+static pp_render_doc_t *render_doc = NULL;
+static portMUX_TYPE render_lock = portMUX_INITIALIZER_UNLOCKED;
+/// @brief Guards render_list, held while the document is built from it. Created with the parameter table.
+static SemaphoreHandle_t render_list_lock = NULL;
+/// @brief Guards the array encoders, held from encoding a frame until it is posted, so frames are
+/// posted in sequence and an encoder is not freed while in use. Created with the parameter table.
+static SemaphoreHandle_t array_lock = NULL;
 
 static const char *TAG = "PP";
 
@@ -59,6 +311,207 @@ static esp_err_t evloop_post(esp_event_loop_handle_t loop_handle, esp_event_base
     return esp_event_post_to(loop_handle, loop_base, id, data, data_size, pdMS_TO_TICKS(POST_WAIT_MS));
 }
 
+/// @brief Convert a scalar value to an integer with the same order, so filters need no floating point.
+/// Floats are sign and magnitude, their bits order like integers once the sign is applied.
+static bool pp_filter_key(parameter_type_t type, const void *data, size_t data_size, int64_t *key)
+{
+    switch (type & TYPE_ALL)
+    {
+    case TYPE_INT32:
+        if (data_size != sizeof(int32_t))
+            return false;
+        *key = *(const int32_t *)data;
+        return true;
+    case TYPE_INT64:
+        if (data_size != sizeof(int64_t))
+            return false;
+        *key = *(const int64_t *)data;
+        return true;
+    case TYPE_BOOL:
+        if (data_size != sizeof(bool))
+            return false;
+        *key = *(const bool *)data ? 1 : 0;
+        return true;
+    case TYPE_FLOAT:
+    {
+        if (data_size != sizeof(float))
+            return false;
+        uint32_t bits;
+        memcpy(&bits, data, sizeof(bits));
+        // NaN has no order, it passes no filter
+        if ((bits & 0x7FFFFFFF) > 0x7F800000)
+            return false;
+        *key = (bits & 0x80000000) ? -(int64_t)(bits & 0x7FFFFFFF) : (int64_t)bits;
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+/// @brief Convert a filter bound to the key of the nearest value of the parameter type on one side of it,
+/// so comparing keys gives the same result as comparing the values with the bound.
+/// @param up The smallest value above the bound, else the largest value below it.
+/// @param open Exclude the bound itself.
+/// @return False if the type has no such value, e.g. no int64 above 1e19 and no float above infinity.
+static bool pp_filter_bound(parameter_type_t type, double bound, bool up, bool open, int64_t *key)
+{
+    if (type == TYPE_FLOAT)
+    {
+        // Converting a double out of the float range is undefined, saturate it to infinity
+        float f = (bound > FLT_MAX) ? INFINITY : (bound < -FLT_MAX) ? -INFINITY : (float)bound;
+        if (up && (open ? f <= bound : f < bound))
+            f = nextafterf(f, INFINITY);
+        else if (!up && (open ? f >= bound : f > bound))
+            f = nextafterf(f, -INFINITY);
+        if (up ? (open ? f <= bound : f < bound) : (open ? f >= bound : f > bound))
+            return false;
+        return pp_filter_key(type, &f, sizeof(float), key);
+    }
+    // Round in double, step past an open bound in int64, the doubles near the ends of int64 are 2048 apart
+    double r = (up == open) ? floor(bound) : ceil(bound);
+    // The largest int64 is not a double, 2^63 is the first double past it
+    double min = (type == TYPE_INT64) ? -9223372036854775808.0 : (type == TYPE_INT32) ? INT32_MIN : 0;
+    double max = (type == TYPE_INT64) ? 9223372036854775808.0 : (type == TYPE_INT32) ? INT32_MAX + 1.0 : 2.0;
+    int64_t min_key = (type == TYPE_INT64) ? INT64_MIN : (int64_t)min;
+    int64_t max_key = (type == TYPE_INT64) ? INT64_MAX : (int64_t)max - 1;
+    if (r >= max)
+    {
+        *key = max_key;
+        return !up;
+    }
+    if (r < min)
+    {
+        *key = min_key;
+        return up;
+    }
+    *key = (int64_t)r;
+    if (open && up)
+    {
+        if (*key == max_key)
+            return false;
+        (*key)++;
+    }
+    else if (open)
+    {
+        if (*key == min_key)
+            return false;
+        (*key)--;
+    }
+    return true;
+}
+
+/// @brief Set the range of keys a filter passes, [low, high], left empty if no value of the type is in it.
+static void pp_filter_range(pp_filtered_t *f, parameter_type_t type, double low, bool low_open, double high, bool high_open)
+{
+    if (!pp_filter_bound(type, low, true, low_open, &f->low) || !pp_filter_bound(type, high, false, high_open, &f->high))
+    {
+        f->low = INT64_MAX;
+        f->high = INT64_MIN;
+    }
+}
+
+static bool pp_filter_pass(pp_filtered_t *f, int64_t key)
+{
+    if (f->kind == PP_FILTER_MASK)
+        return ((uint64_t)key & f->mask) != 0;
+    bool inside = key >= f->low && key <= f->high;
+    switch (f->kind)
+    {
+    case PP_FILTER_ABOVE:
+    case PP_FILTER_BELOW:
+    case PP_FILTER_EQUAL:
+        return inside;
+    case PP_FILTER_RISING:
+    case PP_FILTER_FALLING:
+    case PP_FILTER_ENTER:
+    case PP_FILTER_EXIT:
+        break;
+    default:
+        return false;
+    }
+    bool changed = (inside != f->inside);
+    f->inside = inside;
+    return changed && (inside != (f->kind == PP_FILTER_EXIT));
+}
+
+/// @brief Post the new state to the filtered subscribers of one pass whose filter passes.
+/// @return The number of failed posts.
+static int pp_post_filtered(public_parameter_t *p, void *data, size_t data_size, bool fast, bool irq)
+{
+    int64_t key;
+    if (p->state.filtered.empty() || !pp_filter_key(p->conf.type, data, data_size, &key))
+        return 0;
+    int failed = 0;
+    for (auto it = p->state.filtered.begin(); it != p->state.filtered.end(); it++)
+    {
+        if (it->fast != fast || !pp_filter_pass(&*it, key))
+            continue;
+        int64_t start = pp_trace_active ? esp_timer_get_time() : 0;
+        bool ok;
+        if (irq)
+            ok = ESP_OK == esp_event_isr_post_to(it->evloop.loop_handle, it->evloop.base, it->event_id, data, data_size, NULL);
+        else
+            ok = ESP_OK == evloop_post(it->evloop.loop_handle, it->evloop.base, it->event_id, data, data_size);
+        if (pp_trace_active)
+            pp_trace_record(irq ? PP_TRACE_NEWSTATE_IRQ : PP_TRACE_NEWSTATE, p - par_list, &it->evloop, data_size, ok, start);
+        if (!ok)
+            failed++;
+    }
+    return failed;
+}
+
+/// @brief Post a new state to the relay of a core, which posts it to the receivers on that core.
+/// The receivers are copied into the event, so the relay does not read the subscription list while
+/// it changes. A receiver that unsubscribes meanwhile still gets this state, like a state already queued.
+/// @param count The number of normal subscriptions on the core.
+static bool pp_post_relay(public_parameter_t *p, int core, int count, const void *value, size_t size)
+{
+    uint8_t stack_buf[sizeof(pp_relay_header_t) + 4 * sizeof(pp_evloop_t) + sizeof(pp_value_t)];
+    size_t data_size = sizeof(pp_relay_header_t) + count * sizeof(pp_evloop_t) + size;
+    uint8_t *data = (data_size <= sizeof(stack_buf)) ? stack_buf : (uint8_t *)pp_mem_alloc_sized(PP_MEM_EVENTS, data_size);
+    if (data == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate %d bytes", __func__, data_size);
+        return false;
+    }
+    pp_relay_header_t *header = (pp_relay_header_t *)data;
+    pp_evloop_t *receivers = (pp_evloop_t *)(header + 1);
+    header->pp = pp_handle(p);
+    header->size = size;
+    header->count = 0;
+    for (auto itc = p->state.subscription_list.begin(); itc != p->state.subscription_list.end() && (int)header->count < count; itc++)
+        if (!itc->second.fast && itc->second.core == core)
+            receivers[header->count++] = itc->second.evloop;
+    memcpy(&receivers[count], value, size);
+    const pp_evloop_t *relay = &core_relays[core].evloop;
+    int64_t start = pp_trace_active ? esp_timer_get_time() : 0;
+    bool ok = ESP_OK == evloop_post(relay->loop_handle, relay->base, ID_RELAY, data, data_size);
+    if (pp_trace_active)
+        pp_trace_record(PP_TRACE_NEWSTATE, p - par_list, relay, data_size, ok, start);
+    if (data != stack_buf)
+        pp_mem_free_sized(PP_MEM_EVENTS, data, data_size);
+    return ok;
+}
+
+/// @brief Runs on a core's relay loop, posts a relayed new state to the normal subscriptions on that core.
+static void pp_relay_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    pp_relay_header_t *header = (pp_relay_header_t *)event_data;
+    public_parameter_t *p = pp_resolve(header->pp);
+    if (p == NULL)
+        return;
+    pp_evloop_t *receivers = (pp_evloop_t *)(header + 1);
+    void *value = &receivers[header->count];
+    for (uint32_t i = 0; i < header->count; i++)
+    {
+        int64_t start = pp_trace_active ? esp_timer_get_time() : 0;
+        esp_err_t err = evloop_post(receivers[i].loop_handle, receivers[i].base, p->state.newstate_id, value, header->size);
+        if (pp_trace_active)
+            pp_trace_record(PP_TRACE_NEWSTATE, p - par_list, &receivers[i], header->size, err == ESP_OK, start);
+    }
+}
+
 static bool pp_newstate(public_parameter_t *p, void *data, size_t data_size)
 {
     if (p == NULL)
@@ -77,75 +530,592 @@ static bool pp_newstate(public_parameter_t *p, void *data, size_t data_size)
         return false;
     }
     int size = p->state.subscription_list.size();
-    for (auto itc = p->state.subscription_list.begin(); itc != p->state.subscription_list.end(); itc++)
+    int core = xPortGetCoreID();
+    int relayed[portNUM_PROCESSORS] = {};
+    // High priority subscriptions first, so they are not delayed by posts waiting on full queues
+    for (int pass = 0; pass < 2; pass++)
     {
-        esp_err_t err = evloop_post(itc->second.loop_handle, itc->second.base, p->state.newstate_id, data, data_size);
-        if (err == ESP_OK)
-            size--;
-        else
+        for (auto itc = p->state.subscription_list.begin(); itc != p->state.subscription_list.end(); itc++)
         {
-            // ESP_LOGE(TAG, "%s: Failed sending %s to %s - %s", __func__, p->conf.name ,itc->second.base, esp_err_to_name(err));
-            // esp_backtrace_print(5);
+            if (itc->second.fast != (pass == 0))
+                continue;
+            // Normal subscriptions on another core with a relay are posted once per core by the relay
+            int target = itc->second.core;
+            if (pass == 1 && target >= 0 && target != core && core_relays[target].set)
+            {
+                relayed[target]++;
+                continue;
+            }
+            int64_t start = pp_trace_active ? esp_timer_get_time() : 0;
+            esp_err_t err = evloop_post(itc->second.evloop.loop_handle, itc->second.evloop.base, p->state.newstate_id, data, data_size);
+            if (pp_trace_active)
+                pp_trace_record(PP_TRACE_NEWSTATE, p - par_list, &itc->second.evloop, data_size, err == ESP_OK, start);
+            if (err == ESP_OK)
+                size--;
+            else
+            {
+                // ESP_LOGE(TAG, "%s: Failed sending %s to %s - %s", __func__, p->conf.name ,itc->second.base, esp_err_to_name(err));
+                // esp_backtrace_print(5);
+            }
         }
+        size += pp_post_filtered(p, data, data_size, pass == 0, false);
     }
+    for (int target = 0; target < portNUM_PROCESSORS; target++)
+        if (relayed[target] > 0 && pp_post_relay(p, target, relayed[target], data, data_size))
+            size -= relayed[target];
     return (size == 0); // all sends successful
 }
 
 static bool pp_newstate_irq(public_parameter_t *p, void *data, size_t data_size)
 {
     int size = p->state.subscription_list.size();
-    if (size > 0)
+    if (size > 0 || !p->state.filtered.empty())
     {
-        for (auto itc = p->state.subscription_list.begin(); itc != p->state.subscription_list.end(); itc++)
+        for (int pass = 0; pass < 2; pass++)
         {
-            if (ESP_OK == esp_event_isr_post_to(itc->second.loop_handle, itc->second.base, p->state.newstate_id, data, data_size, NULL))
-                size--;
+            for (auto itc = p->state.subscription_list.begin(); itc != p->state.subscription_list.end(); itc++)
+            {
+                if (itc->second.fast != (pass == 0))
+                    continue;
+                int64_t start = pp_trace_active ? esp_timer_get_time() : 0;
+                bool ok = ESP_OK == esp_event_isr_post_to(itc->second.evloop.loop_handle, itc->second.evloop.base, p->state.newstate_id, data, data_size, NULL);
+                if (pp_trace_active)
+                    pp_trace_record(PP_TRACE_NEWSTATE_IRQ, p - par_list, &itc->second.evloop, data_size, ok, start);
+                if (ok)
+                    size--;
+            }
+            size += pp_post_filtered(p, data, data_size, pass == 0, true);
         }
         return (size == 0); // all sends successful
     }
     return false;
 }
 
-static bool pp_event_handler_register(const pp_evloop_t *evloop, int32_t id, esp_event_handler_t cb, void *p)
+/// @brief Invalidate the cached renderings of p, called when its value changes. Safe from an ISR.
+static void pp_render_changed(public_parameter_t *p)
+{
+    p->state.changes = p->state.changes + 1;
+    if (p->state.render_cache != NULL)
+        render_changes = render_changes + 1;
+}
+
+static void pp_derived_refresh(public_parameter_t *p)
+{
+    if (p->conf.derive.cb == NULL || !p->state.derived_dirty)
+        return;
+    // Clear first, inputs that are derived refresh themselves when read by the callback
+    p->state.derived_dirty = false;
+    p->state.derived_value = p->conf.derive.cb(p->conf.derive.inputs, p->conf.derive.input_count, p->conf.derive.context);
+}
+
+/// @brief Mark all parameters derived from p as dirty. Derived parameters with subscribers are
+/// recomputed and posted in rank order, so each one is evaluated once and only after all of its
+/// inputs are up to date. Parameters without subscribers are recomputed lazily when read.
+/// Runs from the _irq posts too, so the work list holds table indices and a bit per parameter.
+static void pp_derived_invalidate(public_parameter_t *p, bool publish)
+{
+    uint8_t affected[MAX_PUBLIC_PARAMETERS];
+    uint64_t visited = 0;
+    size_t count = 0;
+    size_t next = 0;
+
+    visited |= 1ULL << (p - par_list);
+    affected[count++] = p - par_list;
+    while (next < count)
+    {
+        public_parameter_t *d = &par_list[affected[next++]];
+        for (auto it = d->state.dependents.begin(); it != d->state.dependents.end(); it++)
+        {
+            size_t index = *it - par_list;
+            if (visited & (1ULL << index))
+                continue;
+            visited |= 1ULL << index;
+            affected[count++] = index;
+            (*it)->state.derived_dirty = true;
+            pp_render_changed(*it);
+        }
+    }
+
+    if (!publish)
+        return;
+
+    // Insertion sort on rank, skipping p itself, the lists are short
+    for (size_t i = 2; i < count; i++)
+    {
+        uint8_t index = affected[i];
+        size_t j = i;
+        for (; j > 1 && par_list[affected[j - 1]].conf.derive.rank > par_list[index].conf.derive.rank; j--)
+            affected[j] = affected[j - 1];
+        affected[j] = index;
+    }
+    for (size_t i = 1; i < count; i++)
+    {
+        public_parameter_t *d = &par_list[affected[i]];
+        if (d->state.subscribers == 0)
+            continue;
+        pp_derived_refresh(d);
+        float value = d->state.derived_value;
+        pp_newstate(d, &value, sizeof(float));
+    }
+}
+
+/// @brief Called by the pp_post_newstate functions before the new state is posted.
+/// @param value The new state as the application passed it, recorded by pp_record.h. NULL if not known.
+static void pp_changed(public_parameter_t *p, bool irq, const void *value, size_t size)
+{
+    if (pp_record_active && value != NULL)
+        pp_record_post(p - par_list, value, size);
+    pp_render_changed(p);
+    if (!p->state.dependents.empty())
+        pp_derived_invalidate(p, !irq);
+    if (p->state.persistent && !irq)
+        pp_persist_mark_dirty(pp_handle(p));
+}
+
+/// @brief Register a handler instance. Instances are used on all loops, including the default loop,
+/// so the same callback can be registered with different arguments.
+static bool pp_event_handler_register(const pp_evloop_t *evloop, int32_t id, esp_event_handler_t cb, void *p, esp_event_handler_instance_t *instance)
 {
     esp_err_t err;
     if (evloop->loop_handle == NULL)
     {
-        err = esp_event_handler_register(evloop->base, id, cb, p);
+        err = esp_event_handler_instance_register(evloop->base, id, cb, p, instance);
         ESP_ERROR_CHECK(err);
     }
     else
     {
-        err = esp_event_handler_instance_register_with(evloop->loop_handle, evloop->base, id, cb, p, NULL);
+        err = esp_event_handler_instance_register_with(evloop->loop_handle, evloop->base, id, cb, p, instance);
         ESP_ERROR_CHECK(err);
     }
     return err == ESP_OK;
 }
 
-static bool pp_event_handler_unregister(const pp_evloop_t *evloop, int32_t id, esp_event_handler_t cb)
+static bool pp_event_handler_unregister(const pp_evloop_t *evloop, int32_t id, esp_event_handler_instance_t instance)
 {
     esp_err_t err;
     if (evloop->loop_handle == NULL)
     {
-        err = esp_event_handler_unregister(evloop->base, id, cb);
+        err = esp_event_handler_instance_unregister(evloop->base, id, instance);
         if (err != ESP_OK)
         {
-            ESP_LOGE(TAG, "%s: Failed unregistering %s from %p - %s", __func__, evloop->base, cb, esp_err_to_name(err));
+            ESP_LOGE(TAG, "%s: Failed unregistering %s from %p - %s", __func__, evloop->base, instance, esp_err_to_name(err));
             esp_backtrace_print(5);
         }
     }
     else
     {
-        err = esp_event_handler_unregister_with(evloop->loop_handle, evloop->base, id, cb);
+        err = esp_event_handler_instance_unregister_with(evloop->loop_handle, evloop->base, id, instance);
         if (err != ESP_OK)
         {
-            ESP_LOGE(TAG, "%s: Failed unregistering %s from %p - %s", __func__, evloop->base, cb, esp_err_to_name(err));
+            ESP_LOGE(TAG, "%s: Failed unregistering %s from %p - %s", __func__, evloop->base, instance, esp_err_to_name(err));
             esp_backtrace_print(5);
         }
     }
     return err == ESP_OK;
 }
 
+/// @brief Tell the owner that the demand for a parameter changed, see pp_register_subscribe_cb().
+static void pp_post_demand(public_parameter_t *p, bool subscribe)
+{
+    if (p->conf.owner == NULL || p->state.subscribe_cb == NULL)
+        return;
+    pp_t pp = pp_handle(p);
+    evloop_post(p->conf.owner->loop_handle, p->conf.owner->base, subscribe ? ID_SUBSCRIBE : ID_UNSUBSCRIBE, &pp, sizeof(pp_t));
+}
+
+static void pp_update_demand(public_parameter_t *p, size_t previous_subscribers)
+{
+    uint32_t max_rate_hz = 0;
+    for (auto itc = p->state.subscription_list.begin(); itc != p->state.subscription_list.end(); itc++)
+        for (auto its = itc->second.subscribers.begin(); its != itc->second.subscribers.end(); its++)
+            if (its->max_rate_hz > max_rate_hz)
+                max_rate_hz = its->max_rate_hz;
+
+    bool rate_changed = (max_rate_hz != p->state.max_rate_hz);
+    p->state.max_rate_hz = max_rate_hz;
+    if (previous_subscribers == 0 && p->state.subscribers > 0)
+        pp_post_demand(p, true);
+    else if (previous_subscribers > 0 && p->state.subscribers == 0)
+        pp_post_demand(p, false);
+    else if (p->state.subscribers > 0 && rate_changed)
+        pp_post_demand(p, true);
+}
+
+/// @brief Add a subscriber on the receiver to the parameter's subscription list and notify the owner.
+/// @param evloop The loop the handler is registered on.
+/// @param receiver The receiver passed to subscribe, evloop or the receiver of its fast loop.
+static void pp_add_subscription(public_parameter_t *p, const pp_evloop_t *evloop, const pp_evloop_t *receiver, esp_event_handler_t event_cb, esp_event_handler_instance_t instance, uint32_t max_rate_hz, bool fast)
+{
+    pp_subscription_t &subscription = p->state.subscription_list[pp_receiver_key_t(evloop->loop_handle, evloop->base)];
+    subscription.evloop = *evloop;
+    if (subscription.subscribers.empty())
+    {
+        subscription.fast = fast;
+        auto itcore = loop_cores.find(evloop->loop_handle);
+        subscription.core = (itcore == loop_cores.end()) ? -1 : itcore->second;
+    }
+    else
+        subscription.fast |= fast;
+    subscription.subscribers.push_back({event_cb, instance, pp_receiver_key_t(receiver->loop_handle, receiver->base), max_rate_hz});
+    pp_update_demand(p, p->state.subscribers++);
+}
+
+/// @brief Remove a subscriber. The receiver is removed from the subscription list with its last subscriber.
+/// Subscribers are found by the receiver passed to subscribe, also if the fast loop changed since.
+/// @param evloop Set to the loop the handler was registered on, may be NULL.
+/// @return The removed subscriber's handler instance, or NULL if not found.
+static esp_event_handler_instance_t pp_remove_subscription(public_parameter_t *p, const pp_evloop_t *receiver, esp_event_handler_t event_cb, esp_event_handler_instance_t instance, pp_evloop_t *evloop)
+{
+    pp_receiver_key_t key(receiver->loop_handle, receiver->base);
+    for (auto itc = p->state.subscription_list.begin(); itc != p->state.subscription_list.end(); itc++)
+    {
+        auto &subscribers = itc->second.subscribers;
+        for (auto its = subscribers.begin(); its != subscribers.end(); its++)
+        {
+            if (its->event_cb != event_cb || its->receiver != key || (instance != NULL && its->instance != instance))
+                continue;
+            esp_event_handler_instance_t removed = its->instance;
+            if (evloop != NULL)
+                *evloop = itc->second.evloop;
+            subscribers.erase(its);
+            if (subscribers.empty())
+                p->state.subscription_list.erase(itc);
+            pp_update_demand(p, p->state.subscribers--);
+            return removed;
+        }
+    }
+    return NULL;
+}
+
+/// @brief Calls the subscribe callback of the parameter in the event, registered once per owner loop.
+static void pp_demand_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    pp_t pp = *(pp_t *)event_data;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p != NULL && p->state.subscribe_cb != NULL)
+        p->state.subscribe_cb(pp, event_id == ID_SUBSCRIBE);
+}
+
+/// @brief Dispatches events on a pattern subscription's receiver to the user handler.
+/// The handler is registered once for all event ids, events of other parameters are ignored.
+static void pp_pattern_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    pp_pattern_t *pattern = (pp_pattern_t *)arg;
+    auto it = pattern->matched.find(event_id);
+    if (it != pattern->matched.end())
+        pattern->event_cb(pp_handle(it->second), event_base, event_id, event_data);
+}
+
+static bool pp_pattern_match(const pp_pattern_t *pattern, const public_parameter_t *p)
+{
+    if (!(p->conf.type & pattern->type) || p->conf.type == TYPE_EXECUTE)
+        return false;
+    if (pattern->wildcard)
+        return strncmp(p->conf.name, pattern->prefix.c_str(), pattern->prefix.size()) == 0;
+    return pattern->prefix == p->conf.name;
+}
+
+static void pp_pattern_attach(pp_pattern_t *pattern, public_parameter_t *p)
+{
+    pattern->matched[p->state.newstate_id] = p;
+    pp_add_subscription(p, &pattern->receiver, &pattern->receiver, pp_pattern_event, pattern->instance, 0, false);
+}
+
+static pp_write_token_t pp_write_token_alloc(pp_write_done_cb_t done_cb, void *context)
+{
+    pp_write_token_t token = 0;
+    portENTER_CRITICAL(&write_lock);
+    for (int i = 0; i < MAX_PENDING_WRITES; i++)
+    {
+        pp_write_slot_t *slot = &write_slots[(write_token_counter + i) % MAX_PENDING_WRITES];
+        if (slot->token != 0 && slot->status == PP_WRITE_PENDING)
+            continue;
+        int index = slot - write_slots;
+        write_token_counter += i + 1;
+        token = (write_token_counter << WRITE_TOKEN_SLOT_BITS) | index;
+        if (token == 0)
+            token = (++write_token_counter << WRITE_TOKEN_SLOT_BITS) | index;
+        slot->token = token;
+        slot->status = PP_WRITE_PENDING;
+        slot->done_cb = done_cb;
+        slot->context = context;
+        break;
+    }
+    portEXIT_CRITICAL(&write_lock);
+    if (token == 0)
+        ESP_LOGW(TAG, "%s: More than %d writes pending", __func__, MAX_PENDING_WRITES);
+    return token;
+}
+
+/// @brief Free the slot of a token that was never returned to the caller, done_cb is not called.
+static void pp_write_token_release(pp_write_token_t token)
+{
+    pp_write_slot_t *slot = &write_slots[token & (MAX_PENDING_WRITES - 1)];
+    portENTER_CRITICAL(&write_lock);
+    if (slot->token == token)
+        slot->token = 0;
+    portEXIT_CRITICAL(&write_lock);
+}
+
+static void pp_write_resolve(pp_write_token_t token, pp_write_status_t status, const pp_value_t *applied)
+{
+    if (token == 0)
+        return;
+    pp_write_slot_t *slot = &write_slots[token & (MAX_PENDING_WRITES - 1)];
+    portENTER_CRITICAL(&write_lock);
+    bool valid = (slot->token == token && slot->status == PP_WRITE_PENDING);
+    pp_write_done_cb_t done_cb = slot->done_cb;
+    void *context = slot->context;
+    if (valid)
+    {
+        slot->status = status;
+        if (applied != NULL)
+            slot->applied = *applied;
+    }
+    portEXIT_CRITICAL(&write_lock);
+    if (valid && done_cb != NULL)
+        done_cb(token, status, applied, context);
+}
+
+/// @brief Read the value of a scalar parameter into a pp_value_t.
+static bool pp_read_value(const public_parameter_t *p, pp_value_t *value)
+{
+    if (p->state.valueptr == NULL)
+        return false;
+    switch (p->conf.type & TYPE_ALL)
+    {
+    case TYPE_INT32:
+        value->i32 = *(const int32_t *)p->state.valueptr;
+        return true;
+    case TYPE_INT64:
+        value->i64 = *(const int64_t *)p->state.valueptr;
+        return true;
+    case TYPE_FLOAT:
+        value->f = *(const float *)p->state.valueptr;
+        return true;
+    case TYPE_BOOL:
+        value->b = *(const bool *)p->state.valueptr;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/// @brief Call the owner's write callback and report whether it accepted the value.
+static bool pp_write_apply(public_parameter_t *p, esp_event_base_t event_base, void *value)
+{
+    p->state.write_rejected = false;
+    p->state.write_cb(pp_handle(p), event_base, p->state.write_id, value);
+    return !p->state.write_rejected;
+}
+
+/// @brief Write handler registered for all parameters, strips the header and calls the owner's callback.
+static void pp_write_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    public_parameter_t *p = (public_parameter_t *)arg;
+    pp_write_header_t *header = (pp_write_header_t *)event_data;
+    bool accepted = pp_write_apply(p, event_base, header + 1);
+    if (header->token == 0)
+        return;
+    pp_value_t applied;
+    bool has_value = pp_read_value(p, &applied);
+    pp_write_resolve(header->token, accepted ? PP_WRITE_APPLIED : PP_WRITE_REJECTED, has_value ? &applied : NULL);
+}
+
+/// @brief Applies all writes of a batch in one event on the owner loop.
+static void pp_write_batch_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    pp_write_header_t *header = (pp_write_header_t *)event_data;
+    pp_write_batch_item_t *items = (pp_write_batch_item_t *)(header + 1);
+    size_t count = header->size / sizeof(pp_write_batch_item_t);
+    bool accepted = true;
+    for (size_t i = 0; i < count; i++)
+    {
+        // The parameter may have been deleted since the batch was posted
+        public_parameter_t *p = pp_resolve(items[i].pp);
+        if (p == NULL || p->state.write_cb == NULL)
+            accepted = false;
+        else
+            accepted &= pp_write_apply(p, event_base, &items[i].value);
+    }
+    pp_write_resolve(header->token, accepted ? PP_WRITE_APPLIED : PP_WRITE_REJECTED, NULL);
+}
+
+static bool pp_post_write(public_parameter_t *p, pp_write_token_t token, const void *value, size_t size)
+{
+    if (p == NULL || p->conf.owner == NULL)
+        return false;
+
+    uint8_t stack_buf[sizeof(pp_write_header_t) + sizeof(pp_value_t)];
+    size_t data_size = sizeof(pp_write_header_t) + size;
+    uint8_t *data = (data_size <= sizeof(stack_buf)) ? stack_buf : (uint8_t *)pp_mem_alloc_sized(PP_MEM_EVENTS, data_size);
+    if (data == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate %d bytes", __func__, data_size);
+        return false;
+    }
+    pp_write_header_t *header = (pp_write_header_t *)data;
+    header->token = token;
+    header->size = size;
+    memcpy(header + 1, value, size);
+    int64_t start = pp_trace_active ? esp_timer_get_time() : 0;
+    bool ok = ESP_OK == evloop_post(p->conf.owner->loop_handle, p->conf.owner->base, p->state.write_id, data, data_size);
+    if (pp_trace_active)
+        pp_trace_record(PP_TRACE_WRITE, p - par_list, p->conf.owner, data_size, ok, start);
+    if (data != stack_buf)
+        pp_mem_free_sized(PP_MEM_EVENTS, data, data_size);
+    return ok;
+}
+
+/// @brief Check a write against the parameter's type and metadata before it is posted.
+/// Scalar values may be changed in place, when clamped or rounded to the step.
+static bool pp_check_write(const public_parameter_t *p, parameter_type_t type, void *value, size_t size)
+{
+    if (p == NULL || p->conf.name == NULL)
+        return false;
+    parameter_type_t ptype = (parameter_type_t)(p->conf.type & TYPE_ALL);
+    const pp_meta_t *meta = &p->conf.meta;
+    if (ptype != type && ptype != TYPE_EXECUTE)
+    {
+        ESP_LOGW(TAG, "%s: %s has type 0x%x, written with 0x%x", __func__, p->conf.name, ptype, type);
+        return false;
+    }
+    if (meta->flags & PP_META_READ_ONLY)
+    {
+        ESP_LOGW(TAG, "%s: %s is read only", __func__, p->conf.name);
+        return false;
+    }
+    if (type == TYPE_STRING)
+    {
+        if ((meta->flags & PP_META_MAX_LEN) && size - 1 > meta->max_len)
+        {
+            ESP_LOGW(TAG, "%s: %s is longer than %d", __func__, p->conf.name, meta->max_len);
+            return false;
+        }
+        return true;
+    }
+    if (ptype == TYPE_EXECUTE || type == TYPE_BOOL || !(meta->flags & (PP_META_RANGE | PP_META_STEP | PP_META_ENUM)))
+        return true;
+
+    double v;
+    if (type == TYPE_INT32)
+        v = *(int32_t *)value;
+    else if (type == TYPE_INT64)
+        v = *(int64_t *)value;
+    else
+        v = *(float *)value;
+    // NaN passes every comparison, infinities can not be rounded to a step
+    if (!isfinite(v) && (meta->flags & (PP_META_RANGE | PP_META_STEP)))
+    {
+        ESP_LOGW(TAG, "%s: %s written with a value that is not finite", __func__, p->conf.name);
+        return false;
+    }
+
+    if (meta->flags & PP_META_ENUM)
+    {
+        for (size_t i = 0; i < meta->enum_count; i++)
+            if (meta->enum_values[i] == v)
+                return true;
+        ESP_LOGW(TAG, "%s: %s is not one of the %d allowed values", __func__, p->conf.name, meta->enum_count);
+        return false;
+    }
+
+    double checked = v;
+    bool stepped = (meta->flags & PP_META_STEP) && meta->step > 0;
+    double base = (meta->flags & PP_META_RANGE) ? meta->min : 0;
+    if (stepped)
+        checked = base + round((checked - base) / meta->step) * meta->step;
+    if ((meta->flags & PP_META_RANGE) && (checked < meta->min || checked > meta->max))
+    {
+        if (!(meta->flags & PP_META_CLAMP))
+        {
+            ESP_LOGW(TAG, "%s: %s outside %g..%g", __func__, p->conf.name, meta->min, meta->max);
+            return false;
+        }
+        // Clamped to the last step inside the range, max is not on a step if the range is not a multiple of it
+        if (checked < meta->min)
+            checked = meta->min;
+        else
+            checked = stepped ? base + floor((meta->max - base) / meta->step) * meta->step : meta->max;
+    }
+    if (checked == v)
+        return true;
+    if (type == TYPE_INT32)
+        *(int32_t *)value = (int32_t)llround(checked);
+    else if (type == TYPE_INT64)
+        *(int64_t *)value = (int64_t)llround(checked);
+    else
+        *(float *)value = (float)checked;
+    return true;
+}
+
+/// @brief Check and post a write without a token.
+static bool pp_post_write_checked(public_parameter_t *p, parameter_type_t type, void *value, size_t size)
+{
+    return pp_check_write(p, type, value, size) && pp_post_write(p, 0, value, size);
+}
+
+static pp_write_token_t pp_post_write_async(public_parameter_t *p, parameter_type_t type, void *value, size_t size, pp_write_done_cb_t done_cb, void *context)
+{
+    if (!pp_check_write(p, type, value, size))
+        return 0;
+    if (p->conf.owner == NULL || p->state.write_cb == NULL)
+    {
+        ESP_LOGW(TAG, "%s: %s has no write callback", __func__, p ? p->conf.name : "NULL");
+        return 0;
+    }
+    pp_write_token_t token = pp_write_token_alloc(done_cb, context);
+    if (token == 0)
+        return 0;
+    if (!pp_post_write(p, token, value, size))
+    {
+        pp_write_token_release(token);
+        return 0;
+    }
+    return token;
+}
+
+/// @brief Register the library's handlers on an owner event loop, once per loop.
+static bool pp_register_owner(const pp_evloop_t *owner)
+{
+    for (auto it = owner_loops.begin(); it != owner_loops.end(); it++)
+        if (it->loop_handle == owner->loop_handle && it->base == owner->base)
+            return true;
+    if (!pp_event_handler_register(owner, ID_SUBSCRIBE, pp_demand_event, NULL, NULL) ||
+        !pp_event_handler_register(owner, ID_UNSUBSCRIBE, pp_demand_event, NULL, NULL) ||
+        !pp_event_handler_register(owner, ID_WRITE_BATCH, pp_write_batch_event, NULL, NULL))
+        return false;
+    owner_loops.push_back(*owner);
+    return true;
+}
+
+/// @brief Get the range of the name map holding all parameters below a group.
+/// Names in a group share the prefix "group/", so the group is one contiguous range of the sorted map
+/// ending before the first name starting with "group0" ('0' follows the separator).
+static bool pp_group_range(const char *group, pp_name_map_t::iterator *begin, pp_name_map_t::iterator *end)
+{
+    if (group == NULL || group[0] == 0)
+    {
+        *begin = nameToPP.begin();
+        *end = nameToPP.end();
+        return true;
+    }
+    size_t len = strnlen(group, MAX_PAR_NAME + 1);
+    if (len > MAX_PAR_NAME)
+        return false;
+    if (group[len - 1] == PP_GROUP_SEPARATOR)
+        len--;
+
+    char prefix[MAX_PAR_NAME + 2];
+    memcpy(prefix, group, len);
+    prefix[len] = PP_GROUP_SEPARATOR;
+    prefix[len + 1] = 0;
+    *begin = nameToPP.lower_bound(prefix);
+    prefix[len] = PP_GROUP_SEPARATOR + 1;
+    *end = nameToPP.lower_bound(prefix);
+    return true;
+}
+
 static pp_t pp_create(const char *name, const pp_evloop_t *evloop, parameter_type_t type, esp_event_handler_t event_write_cb, const void *valueptr)
 {
     if (name == NULL)
@@ -160,12 +1130,47 @@ static pp_t pp_create(const char *name, const pp_evloop_t *evloop, parameter_typ
         return NULL;
     }
 
-    std::string key = name;
-    std::map<std::string, public_parameter_t *>::iterator it = nameToPP.find(key);
+    if (strnlen(name, MAX_PAR_NAME + 1) > MAX_PAR_NAME)
+    {
+        ESP_LOGE(TAG, "%s: %s is longer than %d characters", __func__, name, MAX_PAR_NAME);
+        return NULL;
+    }
+
+    pp_name_map_t::iterator it = nameToPP.find(name);
     if (it != nameToPP.end())
     {
         ESP_LOGW(TAG, "%s: %s exist", __func__, name);
-        return it->second;
+        return pp_handle(it->second);
+    }
+
+    if (par_list == NULL)
+    {
+        // Both tables are published together, a failed allocation leaves neither behind
+        public_parameter_t *pars = (public_parameter_t *)pp_mem_alloc_sized(PP_MEM_STATIC, MAX_PUBLIC_PARAMETERS * sizeof(public_parameter_t));
+        public_parameter_t **live = (public_parameter_t **)pp_mem_alloc_sized(PP_MEM_STATIC, MAX_PUBLIC_PARAMETERS * sizeof(public_parameter_t *));
+        render_list_lock = xSemaphoreCreateMutex();
+        array_lock = xSemaphoreCreateMutex();
+        if (pars == NULL || live == NULL || render_list_lock == NULL || array_lock == NULL)
+        {
+            ESP_LOGE(TAG, "%s: Failed to allocate the parameter table", __func__);
+            if (render_list_lock != NULL)
+                vSemaphoreDelete(render_list_lock);
+            if (array_lock != NULL)
+                vSemaphoreDelete(array_lock);
+            render_list_lock = NULL;
+            array_lock = NULL;
+            // In reverse order, so the tables are given back to the arena
+            pp_mem_free_sized(PP_MEM_STATIC, live, MAX_PUBLIC_PARAMETERS * sizeof(public_parameter_t *));
+            pp_mem_free_sized(PP_MEM_STATIC, pars, MAX_PUBLIC_PARAMETERS * sizeof(public_parameter_t));
+            return NULL;
+        }
+        for (int i = 0; i < MAX_PUBLIC_PARAMETERS; i++)
+        {
+            new (&pars[i]) public_parameter_t();
+            pars[i].state.generation = 1;
+        }
+        live_list = live;
+        par_list = pars;
     }
 
     int par_list_index;
@@ -182,20 +1187,47 @@ static pp_t pp_create(const char *name, const pp_evloop_t *evloop, parameter_typ
     }
 
     public_parameter_t *p = &par_list[par_list_index];
-    nameToPP[key] = p;
+    nameToPP[name] = p;
+    p->state.live_index = live_count;
+    live_list[live_count++] = p;
 
     p->conf.name = name;
     p->conf.owner = evloop;
     p->conf.type = type;
+    p->conf.priority = PP_PRIORITY_NORMAL;
     p->conf.json_cb = NULL;
+    memset(&p->conf.meta, 0, sizeof(p->conf.meta));
+    p->conf.derive.cb = NULL;
+    p->conf.derive.input_count = 0;
+    p->conf.derive.rank = 0;
+    p->state.derived_dirty = false;
+    p->state.dependents.clear();
+    p->state.filtered.clear();
+    p->state.array_encoder = NULL;
+    p->state.bridge_exports = 0;
+    p->state.changes = 0;
+    p->state.render_cache = NULL;
+    p->state.persistent = false;
     p->state.newstate_id = event_id_counter++;
     p->state.write_id = event_id_counter++;
     p->state.valueptr = valueptr;
     p->state.is_active = true;
 
+    p->state.subscribers = 0;
+    p->state.max_rate_hz = 0;
+    p->state.write_instance = NULL;
+    p->state.write_cb = NULL;
     if (event_write_cb && evloop)
-        pp_event_handler_register(evloop, p->state.write_id, event_write_cb, p);
-    return p;
+    {
+        p->state.write_cb = event_write_cb;
+        pp_event_handler_register(evloop, p->state.write_id, pp_write_event, p, &p->state.write_instance);
+        pp_register_owner(evloop);
+    }
+
+    for (auto it = pattern_list.begin(); it != pattern_list.end(); it++)
+        if (pp_pattern_match(&*it, p))
+            pp_pattern_attach(&*it, p);
+    return pp_handle(p);
 }
 
 static int pp_json_no_valueptr(const char *name, char *buf, size_t *bufsize, bool json)
@@ -207,7 +1239,9 @@ static int pp_json_no_valueptr(const char *name, char *buf, size_t *bufsize, boo
 
 static bool pp_json_int32(pp_t pp, const char* format, char *buf, size_t *bufsize, bool json)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
     if (p->state.valueptr != NULL)
     {
         int32_t value = *((int32_t *)p->state.valueptr);
@@ -225,7 +1259,9 @@ static bool pp_json_int32(pp_t pp, const char* format, char *buf, size_t *bufsiz
 
 static bool pp_json_int64(pp_t pp, const char* format, char *buf, size_t *bufsize, bool json)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
     if (p->state.valueptr != NULL)
     {
         int64_t value = *((int64_t *)p->state.valueptr);
@@ -243,7 +1279,9 @@ static bool pp_json_int64(pp_t pp, const char* format, char *buf, size_t *bufsiz
 
 static bool pp_json_float(pp_t pp, const char* format, char *buf, size_t *bufsize, bool json)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
     if (p->state.valueptr != NULL)
     {
         if (format == NULL)
@@ -265,7 +1303,9 @@ static bool pp_json_float(pp_t pp, const char* format, char *buf, size_t *bufsiz
 
 static bool pp_json_bool(pp_t pp, const char* format, char *buf, size_t *bufsize, bool json)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
     if (p->state.valueptr != NULL)
     {
         bool value = *((bool *)p->state.valueptr);
@@ -295,8 +1335,8 @@ static bool pp_json_bool(pp_t pp, const char* format, char *buf, size_t *bufsize
 
 bool pp_register_subscribe_cb(const pp_t pp, pp_subscribe_cb_t cb)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    if (pp == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
     {
         ESP_LOGW(TAG, "%s: parameter is NULL", __func__);
         return false;
@@ -306,11 +1346,19 @@ bool pp_register_subscribe_cb(const pp_t pp, pp_subscribe_cb_t cb)
         ESP_LOGW(TAG, "%s: %s already registered", __func__, p->conf.name);
         return false;
     }
+    if (p->conf.owner == NULL)
+    {
+        ESP_LOGW(TAG, "%s: %s has no owner", __func__, p->conf.name);
+        return false;
+    }
+
+    if (!pp_register_owner(p->conf.owner))
+        return false;
+
     p->state.subscribe_cb = cb;
-    return pp_event_handler_register(p->conf.owner, ID_SUBSCRIBE, [](void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
-                                     {
-        public_parameter_t *p = (public_parameter_t *)arg;
-        p->state.subscribe_cb(p, true); }, pp);
+    if (p->state.subscribers > 0)
+        pp_post_demand(p, true);
+    return true;
 }
 
 pp_t pp_create_int32(const char *name, const pp_evloop_t *evloop, esp_event_handler_t event_write_cb, const int32_t *valueptr)
@@ -336,21 +1384,151 @@ pp_t pp_create_float(const char *name, const pp_evloop_t *evloop, esp_event_hand
 }
 bool pp_delete(pp_t pp)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    if (p == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL || p->conf.name == NULL)
+        return false;
+
+    if (!p->state.dependents.empty())
+    {
+        ESP_LOGW(TAG, "%s: %s is input to %d derived parameters", __func__, p->conf.name, p->state.dependents.size());
         return false;
+    }
+    for (size_t i = 0; i < p->conf.derive.input_count; i++)
+        pp_resolve(p->conf.derive.inputs[i])->state.dependents.remove(p);
+    p->conf.derive.cb = NULL;
+    p->conf.derive.input_count = 0;
+    if (p->state.persistent)
+        pp_persist_detach(pp);
+    for (auto it = pattern_list.begin(); it != pattern_list.end(); it++)
+        it->matched.erase(p->state.newstate_id);
+
+    // Pattern handlers are registered for all ids and stay for the other matched parameters
+    for (auto itc = p->state.subscription_list.begin(); itc != p->state.subscription_list.end(); itc++)
+        for (auto its = itc->second.subscribers.begin(); its != itc->second.subscribers.end(); its++)
+            if (its->event_cb != pp_pattern_event)
+                pp_event_handler_unregister(&itc->second.evloop, p->state.newstate_id, its->instance);
+    p->state.subscription_list.clear();
+    for (auto it = p->state.filtered.begin(); it != p->state.filtered.end(); it++)
+        pp_event_handler_unregister(&it->evloop, it->event_id, it->instance);
+    p->state.filtered.clear();
+    p->state.subscribers = 0;
+    p->state.max_rate_hz = 0;
+    p->state.subscribe_cb = NULL;
+    if (p->state.write_instance != NULL)
+        pp_event_handler_unregister(p->conf.owner, p->state.write_id, p->state.write_instance);
+    p->state.write_instance = NULL;
+    p->state.write_cb = NULL;
+    pp_set_render_cache(pp, 0);
+    xSemaphoreTake(array_lock, portMAX_DELAY);
+    pp_array_encoder_free(p->state.array_encoder);
+    p->state.array_encoder = NULL;
+    p->state.bridge_exports = 0;
+    xSemaphoreGive(array_lock);
 
     nameToPP.erase(p->conf.name);
+    // Keep the live list packed, the last parameter takes the free position
+    live_list[p->state.live_index] = live_list[--live_count];
+    live_list[p->state.live_index]->state.live_index = p->state.live_index;
     p->conf.name = NULL;
+    // Handles of the deleted parameter no longer resolve, also when the slot is reused
+    if (++p->state.generation > HANDLE_GENERATION_MAX)
+        p->state.generation = 1;
     return true;
 }
 float pp_get_float_value(pp_t pp)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
     if (p == NULL)
         return 0.0f;
 
-    return *((float *)p->state.valueptr);
+    pp_derived_refresh(p);
+    if (p->state.valueptr == NULL)
+        return 0.0f;
+
+    switch (p->conf.type & TYPE_ALL)
+    {
+    case TYPE_INT32:
+        return (float)*((int32_t *)p->state.valueptr);
+    case TYPE_INT64:
+        return (float)*((int64_t *)p->state.valueptr);
+    case TYPE_BOOL:
+        return *((bool *)p->state.valueptr) ? 1.0f : 0.0f;
+    case TYPE_FLOAT:
+        return *((float *)p->state.valueptr);
+    default:
+        return 0.0f;
+    }
+}
+pp_t pp_create_derived_float(const char *name, const pp_evloop_t *evloop, const pp_t *inputs, size_t count, pp_derive_cb_t cb, void *context)
+{
+    if (inputs == NULL || cb == NULL || count == 0 || count > MAX_DERIVED_INPUTS)
+    {
+        ESP_LOGE(TAG, "%s: %s needs a callback and 1 to %d inputs", __func__, name ? name : "NULL", MAX_DERIVED_INPUTS);
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (pp_resolve(inputs[i]) == NULL)
+        {
+            ESP_LOGE(TAG, "%s: %s input %d is NULL or deleted", __func__, name ? name : "NULL", i);
+            return NULL;
+        }
+        parameter_type_t type = (parameter_type_t)(pp_resolve(inputs[i])->conf.type & TYPE_ALL);
+        if (type != TYPE_INT32 && type != TYPE_INT64 && type != TYPE_FLOAT && type != TYPE_BOOL)
+        {
+            ESP_LOGE(TAG, "%s: %s input %d is not a scalar parameter", __func__, name ? name : "NULL", i);
+            return NULL;
+        }
+    }
+    if (name != NULL && nameToPP.find(name) != nameToPP.end())
+    {
+        ESP_LOGW(TAG, "%s: %s exist", __func__, name);
+        return pp_handle(nameToPP[name]);
+    }
+
+    public_parameter_t *p = pp_resolve(pp_create(name, evloop, TYPE_FLOAT, NULL, NULL));
+    if (p == NULL)
+        return NULL;
+
+    int rank = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        public_parameter_t *in = pp_resolve(inputs[i]);
+        p->conf.derive.inputs[i] = inputs[i];
+        if (in->conf.derive.rank >= rank)
+            rank = in->conf.derive.rank + 1;
+        bool listed = false;
+        for (auto it = in->state.dependents.begin(); it != in->state.dependents.end(); it++)
+            listed |= (*it == p);
+        if (!listed)
+            in->state.dependents.push_back(p);
+    }
+    p->conf.derive.input_count = count;
+    p->conf.derive.context = context;
+    p->conf.derive.rank = rank;
+    p->conf.derive.cb = cb;
+    p->state.derived_dirty = true;
+    p->state.valueptr = &p->state.derived_value;
+    p->conf.json_cb = pp_json_float;
+    return pp_handle(p);
+}
+float pp_derive_sum(const pp_t *inputs, size_t count, void *context)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < count; i++)
+        sum += pp_get_float_value(inputs[i]);
+    return sum;
+}
+float pp_derive_product(const pp_t *inputs, size_t count, void *context)
+{
+    float product = 1.0f;
+    for (size_t i = 0; i < count; i++)
+        product *= pp_get_float_value(inputs[i]);
+    return product;
+}
+float pp_derive_mean(const pp_t *inputs, size_t count, void *context)
+{
+    return count ? pp_derive_sum(inputs, count, context) / count : 0.0f;
 }
 pp_t pp_create_float_array(const char *name, const pp_evloop_t *evloop, esp_event_handler_t event_write_cb)
 {
@@ -376,198 +1554,542 @@ pp_t pp_create_binary(const char *name, const pp_evloop_t *evloop, esp_event_han
 
 pp_t pp_get(const char *name)
 {
-    std::string key = name;
-    std::map<std::string, public_parameter_t *>::iterator it = nameToPP.find(key);
+    pp_name_map_t::iterator it = nameToPP.find(name);
     if (it != nameToPP.end())
-        return (pp_t)it->second;
+        return pp_handle(it->second);
     ESP_LOGW(TAG, "%s: parameter %s not found", __func__, name);
     return NULL;
 }
 
-bool pp_subscribe(pp_t pp, const pp_evloop_t *evloop, esp_event_handler_t event_cb)
+/// @brief Get the loop high priority updates for a receiver are delivered on.
+static const pp_evloop_t *pp_fast_loop(const pp_evloop_t *evloop)
+{
+    auto it = fast_loops.find(evloop->loop_handle);
+    if (it == fast_loops.end())
+        return evloop;
+    return &it->second;
+}
+
+static bool pp_subscribe_with(pp_t pp, const pp_evloop_t *evloop, esp_event_handler_t event_cb, uint32_t max_rate_hz, pp_priority_t priority)
 {
-    if (pp == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
     {
         ESP_LOGW(TAG, "%s: parameter is NULL", __func__);
         return false;
     }
-    public_parameter_t *p = (public_parameter_t *)pp;
     if (p->conf.type == TYPE_EXECUTE)
     {
         ESP_LOGW(TAG, "%s: No subscription for execute", __func__);
         return false;
     }
-    if (pp_event_handler_register(evloop, p->state.newstate_id, event_cb, p))
+    bool fast = (priority == PP_PRIORITY_HIGH || p->conf.priority == PP_PRIORITY_HIGH);
+    const pp_evloop_t *loop = fast ? pp_fast_loop(evloop) : evloop;
+    esp_event_handler_instance_t instance;
+    if (pp_event_handler_register(loop, p->state.newstate_id, event_cb, pp, &instance))
+    {
+        pp_add_subscription(p, loop, evloop, event_cb, instance, max_rate_hz, fast);
+        return true;
+    }
+    return false;
+}
+bool pp_subscribe(pp_t pp, const pp_evloop_t *evloop, esp_event_handler_t event_cb)
+{
+    return pp_subscribe_with(pp, evloop, event_cb, 0, PP_PRIORITY_NORMAL);
+}
+bool pp_subscribe_rate(pp_t pp, const pp_evloop_t *evloop, esp_event_handler_t event_cb, uint32_t max_rate_hz)
+{
+    return pp_subscribe_with(pp, evloop, event_cb, max_rate_hz, PP_PRIORITY_NORMAL);
+}
+bool pp_subscribe_priority(pp_t pp, const pp_evloop_t *evloop, esp_event_handler_t event_cb, pp_priority_t priority)
+{
+    return pp_subscribe_with(pp, evloop, event_cb, 0, priority);
+}
+bool pp_subscribe_filter(pp_t pp, const pp_evloop_t *evloop, esp_event_handler_t event_cb, const pp_filter_t *filter)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL || evloop == NULL || filter == NULL)
+    {
+        ESP_LOGW(TAG, "%s: parameter, event loop and filter are required", __func__);
+        return false;
+    }
+    parameter_type_t type = (parameter_type_t)(p->conf.type & TYPE_ALL);
+    if (type != TYPE_INT32 && type != TYPE_INT64 && type != TYPE_FLOAT && type != TYPE_BOOL)
     {
-        p->state.subscription_list[evloop->loop_handle] = *evloop;
-        if (p->conf.owner != NULL && p->state.subscribe_cb != NULL)
-            evloop_post(p->conf.owner->loop_handle, p->conf.owner->base, ID_SUBSCRIBE, pp, sizeof(pp_t));
+        ESP_LOGW(TAG, "%s: %s is not a scalar parameter", __func__, p->conf.name);
+        return false;
+    }
+    if (filter->kind == PP_FILTER_MASK && (type == TYPE_FLOAT || type == TYPE_BOOL))
+    {
+        ESP_LOGW(TAG, "%s: Mask filter on %s, integer types only", __func__, p->conf.name);
+        return false;
+    }
+    if (filter->kind > PP_FILTER_MASK || isnan(filter->low) || ((filter->kind == PP_FILTER_ENTER || filter->kind == PP_FILTER_EXIT) && isnan(filter->high)))
+    {
+        ESP_LOGW(TAG, "%s: Invalid filter on %s", __func__, p->conf.name);
+        return false;
+    }
 
+    pp_filtered_t f = {};
+    f.event_cb = event_cb;
+    f.kind = filter->kind;
+    f.mask = filter->mask;
+    // Convert the bounds once to a range of keys, so posting compares integers only. ABOVE and BELOW
+    // are the open ranges up to the ends of the type, EQUAL is [bound, bound], which is empty unless
+    // the bound is a value of the type.
+    switch (filter->kind)
+    {
+    case PP_FILTER_ABOVE:
+    case PP_FILTER_RISING:
+        pp_filter_range(&f, type, filter->low, true, INFINITY, false);
+        break;
+    case PP_FILTER_BELOW:
+    case PP_FILTER_FALLING:
+        pp_filter_range(&f, type, -INFINITY, false, filter->low, true);
+        break;
+    case PP_FILTER_EQUAL:
+        pp_filter_range(&f, type, filter->low, false, filter->low, false);
+        break;
+    case PP_FILTER_ENTER:
+    case PP_FILTER_EXIT:
+        pp_filter_range(&f, type, filter->low, false, filter->high, false);
+        break;
+    default:
+        break;
+    }
+    f.fast = (p->conf.priority == PP_PRIORITY_HIGH);
+    f.evloop = f.fast ? *pp_fast_loop(evloop) : *evloop;
+    f.receiver = pp_receiver_key_t(evloop->loop_handle, evloop->base);
+    f.event_id = event_id_counter++;
+    if (!pp_event_handler_register(&f.evloop, f.event_id, event_cb, pp, &f.instance))
+        return false;
+    p->state.filtered.push_back(f);
+    pp_update_demand(p, p->state.subscribers++);
+    return true;
+}
+bool pp_set_fast_loop(const pp_evloop_t *evloop, const pp_evloop_t *fast_loop)
+{
+    if (evloop == NULL)
+        return false;
+    if (fast_loop == NULL)
+        fast_loops.erase(evloop->loop_handle);
+    else
+        fast_loops[evloop->loop_handle] = *fast_loop;
+    return true;
+}
+bool pp_set_loop_core(const pp_evloop_t *evloop, int core)
+{
+    if (evloop == NULL || core >= portNUM_PROCESSORS)
+        return false;
+    if (core < 0)
+        loop_cores.erase(evloop->loop_handle);
+    else
+        loop_cores[evloop->loop_handle] = core;
+    // Move the existing subscriptions of the loop as well
+    for (size_t i = 0; i < live_count; i++)
+    {
+        auto &subscriptions = live_list[i]->state.subscription_list;
+        for (auto itc = subscriptions.begin(); itc != subscriptions.end(); itc++)
+            if (itc->second.evloop.loop_handle == evloop->loop_handle)
+                itc->second.core = (core < 0) ? -1 : core;
+    }
+    return true;
+}
+bool pp_set_core_relay(int core, const pp_evloop_t *relay)
+{
+    if (core < 0 || core >= portNUM_PROCESSORS)
+        return false;
+    if (core_relays[core].set)
+    {
+        core_relays[core].set = false;
+        pp_event_handler_unregister(&core_relays[core].evloop, ID_RELAY, core_relays[core].instance);
+    }
+    if (relay == NULL)
         return true;
+    if (!pp_event_handler_register(relay, ID_RELAY, pp_relay_event, (void *)(intptr_t)core, &core_relays[core].instance))
+        return false;
+    core_relays[core].evloop = *relay;
+    core_relays[core].set = true;
+    return true;
+}
+bool pp_set_priority(pp_t pp, pp_priority_t priority)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
+    if (p->state.subscribers > 0)
+        ESP_LOGW(TAG, "%s: %s already has subscribers, they keep their priority", __func__, p->conf.name);
+    p->conf.priority = priority;
+    return true;
+}
+pp_priority_t pp_get_priority(pp_t pp)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return PP_PRIORITY_NORMAL;
+    return p->conf.priority;
+}
+pp_pattern_t *pp_subscribe_pattern(const char *pattern, parameter_type_t type, const pp_evloop_t *evloop, esp_event_handler_t event_cb)
+{
+    if (pattern == NULL || evloop == NULL || event_cb == NULL)
+    {
+        ESP_LOGW(TAG, "%s: pattern, event loop and callback are required", __func__);
+        return NULL;
+    }
+    const char *star = strchr(pattern, '*');
+    if (star != NULL && star[1] != 0)
+    {
+        ESP_LOGE(TAG, "%s: '*' is only supported at the end of %s", __func__, pattern);
+        return NULL;
+    }
+
+    pattern_list.emplace_back();
+    pp_pattern_t *s = &pattern_list.back();
+    s->wildcard = (star != NULL);
+    s->prefix.assign(pattern, s->wildcard ? star - pattern : strlen(pattern));
+    s->type = type;
+    s->receiver = *evloop;
+    s->event_cb = event_cb;
+    s->instance = NULL;
+
+    if (!pp_event_handler_register(evloop, ESP_EVENT_ANY_ID, pp_pattern_event, s, &s->instance))
+    {
+        pattern_list.pop_back();
+        return NULL;
+    }
+
+    // The name map is sorted, all names starting with the prefix are in one range
+    auto it = s->wildcard ? nameToPP.lower_bound(s->prefix.c_str()) : nameToPP.find(s->prefix.c_str());
+    for (; it != nameToPP.end(); it++)
+    {
+        if (strncmp(it->first, s->prefix.c_str(), s->prefix.size()) != 0)
+            break;
+        if (pp_pattern_match(s, it->second))
+            pp_pattern_attach(s, it->second);
+        if (!s->wildcard)
+            break;
+    }
+    return s;
+}
+bool pp_unsubscribe_pattern(pp_pattern_t *pattern)
+{
+    for (auto it = pattern_list.begin(); it != pattern_list.end(); it++)
+    {
+        if (&*it != pattern)
+            continue;
+        for (auto itm = it->matched.begin(); itm != it->matched.end(); itm++)
+            pp_remove_subscription(itm->second, &it->receiver, pp_pattern_event, it->instance, NULL);
+        bool ok = pp_event_handler_unregister(&it->receiver, ESP_EVENT_ANY_ID, it->instance);
+        pattern_list.erase(it);
+        return ok;
     }
+    ESP_LOGW(TAG, "%s: pattern subscription not found", __func__);
     return false;
 }
 bool pp_unsubscribe(pp_t pp, const pp_evloop_t *evloop, esp_event_handler_t event_cb)
 {
-    if (pp == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
     {
         ESP_LOGW(TAG, "%s: parameter is NULL", __func__);
         return false;
     }
-
-    public_parameter_t *p = (public_parameter_t *)pp;
-    if (p->conf.owner != NULL)
-        evloop_post(p->conf.owner->loop_handle, p->conf.owner->base, ID_UNSUBSCRIBE, pp, sizeof(pp_t));
-    return pp_event_handler_unregister(evloop, p->state.newstate_id, event_cb);
+    // High priority handlers are registered on the fast loop the receiver had when subscribing
+    pp_evloop_t registered;
+    esp_event_handler_instance_t instance = pp_remove_subscription(p, evloop, event_cb, NULL, &registered);
+    if (instance == NULL)
+    {
+        pp_receiver_key_t key(evloop->loop_handle, evloop->base);
+        for (auto it = p->state.filtered.begin(); it != p->state.filtered.end(); it++)
+        {
+            if (it->event_cb != event_cb || it->receiver != key)
+                continue;
+            bool ok = pp_event_handler_unregister(&it->evloop, it->event_id, it->instance);
+            p->state.filtered.erase(it);
+            pp_update_demand(p, p->state.subscribers--);
+            return ok;
+        }
+    }
+    if (instance == NULL)
+    {
+        ESP_LOGW(TAG, "%s: %s is not subscribed on %s", __func__, p->conf.name, evloop->base);
+        return false;
+    }
+    return pp_event_handler_unregister(&registered, p->state.newstate_id, instance);
 }
 bool pp_post_write_bool(pp_t pp, bool value)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    if (p == NULL || p->conf.owner == NULL)
-        return false;
-    return ESP_OK == evloop_post(p->conf.owner->loop_handle, p->conf.owner->base, p->state.write_id, (void *)&value, sizeof(bool));
+    return pp_post_write_checked(pp_resolve(pp), TYPE_BOOL, &value, sizeof(bool));
 }
 bool pp_post_write_int32(pp_t pp, int32_t value)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    if (p == NULL || p->conf.owner == NULL)
-        return false;
-    return ESP_OK == evloop_post(p->conf.owner->loop_handle, p->conf.owner->base, p->state.write_id, (void *)&value, sizeof(int32_t));
+    return pp_post_write_checked(pp_resolve(pp), TYPE_INT32, &value, sizeof(int32_t));
 }
 bool pp_post_write_int64(pp_t pp, int64_t value)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    if (p == NULL || p->conf.owner == NULL)
-        return false;
-    return ESP_OK == evloop_post(p->conf.owner->loop_handle, p->conf.owner->base, p->state.write_id, (void *)&value, sizeof(int64_t));
+    return pp_post_write_checked(pp_resolve(pp), TYPE_INT64, &value, sizeof(int64_t));
 }
 bool pp_post_write_float(pp_t pp, float value)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    if (p == NULL || p->conf.owner == NULL)
-        return false;
-    return ESP_OK == evloop_post(p->conf.owner->loop_handle, p->conf.owner->base, p->state.write_id, (void *)&value, sizeof(float));
+    return pp_post_write_checked(pp_resolve(pp), TYPE_FLOAT, &value, sizeof(float));
 }
 bool pp_post_write_string(pp_t pp, const char *str)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    if (p == NULL || p->conf.owner == NULL)
+    if (str == NULL)
         return false;
-    return ESP_OK == evloop_post(p->conf.owner->loop_handle, p->conf.owner->base, p->state.write_id, (void *)str, strlen(str) + 1);
+    return pp_post_write_checked(pp_resolve(pp), TYPE_STRING, (void *)str, strlen(str) + 1);
+}
+pp_write_token_t pp_post_write_bool_async(pp_t pp, bool value, pp_write_done_cb_t done_cb, void *context)
+{
+    return pp_post_write_async(pp_resolve(pp), TYPE_BOOL, &value, sizeof(bool), done_cb, context);
+}
+pp_write_token_t pp_post_write_int32_async(pp_t pp, int32_t value, pp_write_done_cb_t done_cb, void *context)
+{
+    return pp_post_write_async(pp_resolve(pp), TYPE_INT32, &value, sizeof(int32_t), done_cb, context);
+}
+pp_write_token_t pp_post_write_int64_async(pp_t pp, int64_t value, pp_write_done_cb_t done_cb, void *context)
+{
+    return pp_post_write_async(pp_resolve(pp), TYPE_INT64, &value, sizeof(int64_t), done_cb, context);
+}
+pp_write_token_t pp_post_write_float_async(pp_t pp, float value, pp_write_done_cb_t done_cb, void *context)
+{
+    return pp_post_write_async(pp_resolve(pp), TYPE_FLOAT, &value, sizeof(float), done_cb, context);
+}
+pp_write_token_t pp_post_write_string_async(pp_t pp, const char *str, pp_write_done_cb_t done_cb, void *context)
+{
+    if (str == NULL)
+        return 0;
+    return pp_post_write_async(pp_resolve(pp), TYPE_STRING, (void *)str, strlen(str) + 1, done_cb, context);
+}
+pp_write_token_t pp_post_write_batch(const pp_write_item_t *items, size_t count, pp_write_done_cb_t done_cb, void *context)
+{
+    if (items == NULL || count == 0 || count > MAX_WRITE_BATCH)
+    {
+        ESP_LOGW(TAG, "%s: 1 to %d items required", __func__, MAX_WRITE_BATCH);
+        return 0;
+    }
+    size_t data_size = sizeof(pp_write_header_t) + count * sizeof(pp_write_batch_item_t);
+    uint8_t *data = (uint8_t *)pp_mem_alloc_sized(PP_MEM_EVENTS, data_size);
+    if (data == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate %d bytes", __func__, data_size);
+        return 0;
+    }
+    pp_write_header_t *header = (pp_write_header_t *)data;
+    pp_write_batch_item_t *batch = (pp_write_batch_item_t *)(header + 1);
+    const pp_evloop_t *owner = NULL;
+    public_parameter_t *first = NULL;
+    const char *error = NULL;
+    size_t i;
+    // Checked values are written to the event as they are, clamped or rounded
+    for (i = 0; i < count; i++)
+    {
+        public_parameter_t *p = pp_resolve(items[i].pp);
+        batch[i].pp = items[i].pp;
+        batch[i].value = items[i].value;
+        if (p == NULL || p->conf.owner == NULL || p->state.write_cb == NULL)
+        {
+            error = "has no write callback";
+            break;
+        }
+        parameter_type_t type = (parameter_type_t)(p->conf.type & TYPE_ALL);
+        if ((type != TYPE_INT32 && type != TYPE_INT64 && type != TYPE_FLOAT && type != TYPE_BOOL) ||
+            !pp_check_write(p, type, &batch[i].value, sizeof(pp_value_t)))
+            error = "is not a valid scalar write";
+        else if (owner == NULL)
+        {
+            owner = p->conf.owner;
+            first = p;
+        }
+        else if (owner->loop_handle != p->conf.owner->loop_handle || owner->base != p->conf.owner->base)
+            error = "has another owner than the first item";
+        if (error != NULL)
+            break;
+    }
+    if (error != NULL)
+    {
+        ESP_LOGW(TAG, "%s: item %d %s", __func__, i, error);
+        pp_mem_free_sized(PP_MEM_EVENTS, data, data_size);
+        return 0;
+    }
+    pp_write_token_t token = pp_write_token_alloc(done_cb, context);
+    if (token == 0)
+    {
+        pp_mem_free_sized(PP_MEM_EVENTS, data, data_size);
+        return 0;
+    }
+    header->token = token;
+    header->size = count * sizeof(pp_write_batch_item_t);
+    int64_t start = pp_trace_active ? esp_timer_get_time() : 0;
+    bool ok = ESP_OK == evloop_post(owner->loop_handle, owner->base, ID_WRITE_BATCH, data, data_size);
+    if (pp_trace_active)
+        pp_trace_record(PP_TRACE_WRITE_BATCH, first - par_list, owner, data_size, ok, start);
+    pp_mem_free_sized(PP_MEM_EVENTS, data, data_size);
+    if (!ok)
+    {
+        pp_write_token_release(token);
+        return 0;
+    }
+    return token;
+}
+pp_write_status_t pp_get_write_status(pp_write_token_t token, pp_value_t *applied)
+{
+    pp_write_slot_t *slot = &write_slots[token & (MAX_PENDING_WRITES - 1)];
+    pp_write_status_t status = PP_WRITE_UNKNOWN;
+    portENTER_CRITICAL(&write_lock);
+    if (token != 0 && slot->token == token)
+    {
+        status = slot->status;
+        if (applied != NULL)
+            *applied = slot->applied;
+    }
+    portEXIT_CRITICAL(&write_lock);
+    return status;
+}
+void pp_write_reject(pp_t pp)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p != NULL)
+        p->state.write_rejected = true;
 }
 
 bool pp_post_newstate_string(pp_t pp, const char *str)
 {
-    if (pp == NULL || str == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL || str == NULL)
         return false;
 
-    public_parameter_t *p = (public_parameter_t *)pp;
+    pp_changed(p, false, str, strlen(str) + 1);
 
-    if (p->state.subscription_list.size() > 0)
+    if (p->state.subscribers > 0)
         return pp_newstate(p, (void *)str, strlen(str) + 1);
     return false;
 }
 
 bool pp_post_newstate_binary(pp_t pp, void *bin, size_t size)
 {
-    if (pp == NULL || bin == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL || bin == NULL)
         return false;
 
-    public_parameter_t *p = (public_parameter_t *)pp;
+    pp_changed(p, false, bin, size);
 
-    if (p->state.subscription_list.size() > 0)
+    if (p->state.subscribers > 0)
         return pp_newstate(p, (void *)bin, size);
     return true;
 }
 
 bool pp_post_newstate_int32(pp_t pp, int32_t i)
 {
-    if (pp == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
         return false;
 
-    public_parameter_t *p = (public_parameter_t *)pp;
+    pp_changed(p, false, &i, sizeof(int32_t));
 
-    if (p->state.subscription_list.size() > 0)
+    if (p->state.subscribers > 0)
         return pp_newstate(p, &i, sizeof(int32_t));
     return true;
 }
 
 bool pp_post_newstate_int64(pp_t pp, int64_t i)
 {
-    if (pp == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
         return false;
 
-    public_parameter_t *p = (public_parameter_t *)pp;
+    pp_changed(p, false, &i, sizeof(int64_t));
 
-    if (p->state.subscription_list.size() > 0)
+    if (p->state.subscribers > 0)
         return pp_newstate(p, &i, sizeof(int64_t));
     return true;
 }
 
 bool pp_post_newstate_int32_irq(pp_t pp, int32_t i)
 {
-    if (pp == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
         return false;
 
-    public_parameter_t *p = (public_parameter_t *)pp;
+    pp_changed(p, true, &i, sizeof(int32_t));
 
     return pp_newstate_irq(p, &i, sizeof(int32_t));
 }
 
 bool pp_post_newstate_bool(pp_t pp, bool b)
 {
-    if (pp == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
         return false;
 
-    public_parameter_t *p = (public_parameter_t *)pp;
+    pp_changed(p, false, &b, sizeof(bool));
 
-    if (p->state.subscription_list.size() > 0)
+    if (p->state.subscribers > 0)
         return pp_newstate(p, &b, sizeof(bool));
     return true;
 }
 
 bool pp_post_newstate_bool_irq(pp_t pp, bool b)
 {
-    if (pp == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
         return false;
 
-    public_parameter_t *p = (public_parameter_t *)pp;
+    pp_changed(p, true, &b, sizeof(bool));
 
     return pp_newstate_irq(p, &b, sizeof(bool));
 }
 
 bool pp_post_newstate_float(pp_t pp, float f)
 {
-    if (pp == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
         return false;
 
-    public_parameter_t *p = (public_parameter_t *)pp;
+    pp_changed(p, false, &f, sizeof(float));
 
-    if (p->state.subscription_list.size() > 0)
+    if (p->state.subscribers > 0)
         return pp_newstate(p, &f, sizeof(float));
     return true;
 }
 
 bool pp_post_newstate_float_irq(pp_t pp, float f)
 {
-    if (pp == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
         return false;
 
-    public_parameter_t *p = (public_parameter_t *)pp;
+    pp_changed(p, true, &f, sizeof(float));
 
     return pp_newstate_irq(p, &f, sizeof(float));
 }
 
 bool pp_post_newstate_float_array(pp_t pp, pp_float_array_t *fsrc)
 {
-    if (pp == NULL || fsrc == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL || fsrc == NULL)
         return false;
 
-    public_parameter_t *p = (public_parameter_t *)pp;
+    pp_changed(p, false, fsrc->data, fsrc->len * sizeof(float));
+
+    if (p->state.subscribers == 0)
+        return false;
+    if (p->state.array_encoder == NULL)
+        return pp_newstate(p, (void *)fsrc, pp_get_float_array_byte_size(fsrc->len));
 
-    if (p->state.subscription_list.size() > 0)
+    // Encoded once for all subscribers
+    xSemaphoreTake(array_lock, portMAX_DELAY);
+    if (p->state.array_encoder == NULL)
+    {
+        xSemaphoreGive(array_lock);
         return pp_newstate(p, (void *)fsrc, pp_get_float_array_byte_size(fsrc->len));
-    return false;
+    }
+    size_t size;
+    void *frame = pp_array_encode(p->state.array_encoder, fsrc, p->state.subscribers, &size);
+    bool ok = frame != NULL && pp_newstate(p, frame, size);
+    xSemaphoreGive(array_lock);
+    pp_mem_free_sized(PP_MEM_EVENTS, frame, size);
+    return ok;
 }
 
 void pp_reset_float_array(pp_float_array_t *array)
@@ -582,13 +2104,15 @@ void pp_reset_int16_array(pp_int16_array_t *array)
 
 pp_float_array_t *pp_allocate_float_array(size_t nrFloats)
 {
-    pp_float_array_t *p = (pp_float_array_t *)hooks.calloc_fn(1, pp_get_float_array_byte_size(nrFloats));
+    size_t size = pp_get_float_array_byte_size(nrFloats);
+    pp_float_array_t *p = (pp_float_array_t *)pp_mem_alloc(PP_MEM_BUFFERS, size);
     if (p == 0)
     {
         ESP_LOGE(TAG, "Failed to allocate %d bytes", nrFloats);
         esp_backtrace_print(5);
         return NULL;
     }
+    memset(p, 0, size);
     p->len = nrFloats;
     return p;
 }
@@ -600,19 +2124,26 @@ size_t pp_get_float_array_byte_size(size_t len)
 
 const void *pp_get_valueptr(pp_t pp)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return NULL;
+    pp_derived_refresh(p);
     return p->state.valueptr;
 }
 
 const char *pp_get_name(pp_t pp)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return NULL;
     return p->conf.name;
 }
 
 parameter_type_t pp_get_type(pp_t pp)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return TYPE_UNKNOWN;
     return p->conf.type;
 }
 
@@ -624,97 +2155,423 @@ parameter_type_t pp_get_type(pp_t pp)
 
 const pp_evloop_t *pp_get_owner(pp_t pp)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return NULL;
     return p->conf.owner;
 }
 
 int pp_get_subscriptions(pp_t pp)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    return p->state.subscription_list.size();
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return 0;
+    return p->state.subscribers;
+}
+
+bool pp_get_demand(pp_t pp, pp_demand_t *demand)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL || demand == NULL)
+        return false;
+    demand->subscribers = p->state.subscribers;
+    demand->max_rate_hz = p->state.max_rate_hz;
+    return true;
 }
 
 pp_t pp_get_par(int index)
 {
-    if (index >= MAX_PUBLIC_PARAMETERS)
+    if (index >= MAX_PUBLIC_PARAMETERS || par_list == NULL)
         return NULL;
-    return (pp_t)&par_list[index];
+    return pp_handle(&par_list[index]);
 }
 
 bool pp_set_json_cb(pp_t pp, pp_json_cb_t json_cb)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
     p->conf.json_cb = json_cb;
     return true;
 }
 
 bool pp_set_valueptr(pp_t pp, const void *valueptr)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
     p->state.valueptr = valueptr;
+    pp_render_changed(p);
     return true;
 }
 
-bool pp_to_string(pp_t pp, const char* format, char *buf, size_t *bufsize)
+/// @brief Copy a rendering like snprintf() would, truncated to the buffer and bufsize set to its length.
+static void pp_render_copy(const char *src, size_t len, char *buf, size_t *bufsize)
+{
+    if (*bufsize > len)
+        memcpy(buf, src, len + 1);
+    else if (*bufsize > 0)
+    {
+        memcpy(buf, src, *bufsize - 1);
+        buf[*bufsize - 1] = '\0';
+    }
+    *bufsize = len;
+}
+
+static bool pp_render_format_is(const char *cached, bool has_format, const char *format)
+{
+    if (format == NULL)
+        return !has_format;
+    return has_format && strcmp(cached, format) == 0;
+}
+
+/// @brief Render the value with the json callback, or copy it from the render cache if neither
+/// the value nor the format changed since it was rendered.
+static bool pp_render(public_parameter_t *p, const char *format, char *buf, size_t *bufsize, bool json)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
     if (p->conf.json_cb == NULL)
         return false;
-    return p->conf.json_cb(p, format, buf, bufsize, false);
+    pp_derived_refresh(p);
+    if (format != NULL && strlen(format) >= PP_RENDER_FORMAT_MAX)
+        return p->conf.json_cb(pp_handle(p), format, buf, bufsize, json);
+
+    // The cache is only touched under render_lock, pp_set_render_cache() may free it at any time
+    int kind = json ? 1 : 0;
+    bool cached = false;
+    bool hit = false;
+    portENTER_CRITICAL(&render_lock);
+    pp_render_cache_t *cache = p->state.render_cache;
+    if (cache != NULL)
+    {
+        cached = true;
+        if (cache->valid[kind] && cache->rendered[kind] == p->state.changes && pp_render_format_is(cache->format, cache->has_format, format))
+        {
+            pp_render_copy((char *)(cache + 1) + kind * cache->size, cache->len[kind], buf, bufsize);
+            hit = true;
+        }
+    }
+    portEXIT_CRITICAL(&render_lock);
+    if (hit)
+        return true;
+    if (!cached)
+        return p->conf.json_cb(pp_handle(p), format, buf, bufsize, json);
+
+    // Render outside the lock, the value may change meanwhile and then the rendering is not kept
+    uint32_t changes = p->state.changes;
+    size_t size = *bufsize;
+    if (!p->conf.json_cb(pp_handle(p), format, buf, bufsize, json))
+        return false;
+    if (*bufsize >= size)
+        return true;
+    portENTER_CRITICAL(&render_lock);
+    cache = p->state.render_cache;
+    if (cache != NULL && *bufsize < cache->size && changes == p->state.changes)
+    {
+        if (!pp_render_format_is(cache->format, cache->has_format, format))
+        {
+            cache->valid[0] = cache->valid[1] = false;
+            cache->has_format = format != NULL;
+            if (format != NULL)
+                strcpy(cache->format, format);
+        }
+        memcpy((char *)(cache + 1) + kind * cache->size, buf, *bufsize + 1);
+        cache->len[kind] = *bufsize;
+        cache->rendered[kind] = changes;
+        cache->valid[kind] = true;
+    }
+    portEXIT_CRITICAL(&render_lock);
+    return true;
+}
+
+bool pp_to_string(pp_t pp, const char* format, char *buf, size_t *bufsize)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
+    return pp_render(p, format, buf, bufsize, false);
 }
 
 bool pp_to_json_string(pp_t pp, const char* format, char *buf, size_t *bufsize)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    if (p->conf.json_cb == NULL)
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
+    return pp_render(p, format, buf, bufsize, true);
+}
+
+bool pp_set_render_cache(pp_t pp, size_t size)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
+
+    pp_render_cache_t *cache = NULL;
+    if (size > 0)
+    {
+        cache = (pp_render_cache_t *)pp_mem_alloc(PP_MEM_CACHE, sizeof(pp_render_cache_t) + 2 * size);
+        if (cache == NULL)
+        {
+            ESP_LOGE(TAG, "%s: Failed to allocate the cache of %s", __func__, p->conf.name);
+            return false;
+        }
+        memset(cache, 0, sizeof(pp_render_cache_t));
+        cache->size = size;
+    }
+
+    xSemaphoreTake(render_list_lock, portMAX_DELAY);
+    portENTER_CRITICAL(&render_lock);
+    pp_render_cache_t *old = p->state.render_cache;
+    p->state.render_cache = cache;
+    render_changes = render_changes + 1;
+    portEXIT_CRITICAL(&render_lock);
+
+    if (old == NULL && cache != NULL)
+        render_list.push_back(p);
+    else if (old != NULL && cache == NULL)
+        render_list.remove(p);
+    xSemaphoreGive(render_list_lock);
+    pp_free(old);
+    return true;
+}
+
+/// @brief Drop a reference to a document, freeing it with the last one.
+static void pp_render_doc_release(pp_render_doc_t *doc)
+{
+    portENTER_CRITICAL(&render_lock);
+    bool last = --doc->refs == 0;
+    portEXIT_CRITICAL(&render_lock);
+    if (last)
+        pp_free(doc);
+}
+
+bool pp_get_json_document(const char *format, char *buf, size_t *bufsize)
+{
+    if (bufsize == NULL || (format != NULL && strlen(format) >= PP_RENDER_FORMAT_MAX))
         return false;
-    return p->conf.json_cb(p, format, buf, bufsize, false);
+    if (render_list_lock == NULL)
+    {
+        pp_render_copy("[]", 2, buf, bufsize);
+        return true;
+    }
+
+    // Only the reference is taken under the lock, the copy may be long
+    pp_render_doc_t *cached = NULL;
+    size_t size = 64;
+    portENTER_CRITICAL(&render_lock);
+    if (render_doc != NULL)
+    {
+        size = render_doc->len + 2;
+        if (render_doc->rendered == render_changes && pp_render_format_is(render_doc->format, render_doc->has_format, format))
+        {
+            cached = render_doc;
+            cached->refs++;
+        }
+    }
+    portEXIT_CRITICAL(&render_lock);
+    if (cached != NULL)
+    {
+        pp_render_copy((const char *)(cached + 1), cached->len, buf, bufsize);
+        pp_render_doc_release(cached);
+        return true;
+    }
+
+    // Build a new document from the fragments, most of them are copied from the parameters' caches
+    xSemaphoreTake(render_list_lock, portMAX_DELAY);
+    uint32_t changes = render_changes;
+    pp_render_doc_t *doc = NULL;
+    char *text = NULL;
+    size_t len = 0;
+    bool done = false;
+    while (!done)
+    {
+        pp_free(doc);
+        doc = (pp_render_doc_t *)pp_mem_alloc(PP_MEM_CACHE, sizeof(pp_render_doc_t) + size);
+        if (doc == NULL)
+        {
+            xSemaphoreGive(render_list_lock);
+            ESP_LOGE(TAG, "%s: Failed to allocate %d bytes", __func__, size);
+            return false;
+        }
+        text = (char *)(doc + 1);
+        len = 0;
+        text[len++] = '[';
+        for (auto it = render_list.begin(); it != render_list.end(); it++)
+        {
+            // Past the end of the buffer only the length is counted
+            size_t start = len;
+            if (start > 1)
+            {
+                if (len < size)
+                    text[len] = ',';
+                len++;
+            }
+            size_t fragment = (len < size) ? size - len : 0;
+            if (pp_render(*it, format, text + ((len < size) ? len : 0), &fragment, true))
+                len += fragment;
+            else
+                len = start;
+        }
+        // Room for the closing bracket and the terminator, else grow and render again
+        done = len + 2 <= size;
+        if (!done)
+            size = len + 2 + len / 2;
+    }
+    xSemaphoreGive(render_list_lock);
+    text[len++] = ']';
+    text[len] = '\0';
+    pp_render_copy(text, len, buf, bufsize);
+
+    doc->refs = 1;
+    doc->len = len;
+    doc->rendered = changes;
+    doc->has_format = format != NULL;
+    if (format != NULL)
+        strcpy(doc->format, format);
+    pp_render_doc_t *old = NULL;
+    portENTER_CRITICAL(&render_lock);
+    if (changes == render_changes)
+    {
+        old = render_doc;
+        render_doc = doc;
+        doc = NULL;
+    }
+    portEXIT_CRITICAL(&render_lock);
+    if (old != NULL)
+        pp_render_doc_release(old);
+    pp_free(doc);
+    return true;
+}
+
+static void pp_fill_info(const public_parameter_t *p, pp_info_t *info)
+{
+    info->name = p->conf.name;
+    info->type = p->conf.type;
+    info->owner = p->conf.owner;
+    info->subscriptions = p->state.subscribers;
+    info->valueptr = p->state.valueptr;
 }
 
 int pp_get_info(int index, pp_info_t *info)
 {
-    while (index < MAX_PUBLIC_PARAMETERS)
+    while (index >= 0 && index < MAX_PUBLIC_PARAMETERS && par_list != NULL)
     {
         public_parameter_t *p = &par_list[index];
         if (p->conf.name != NULL)
         {
-            info->name = p->conf.name;
-            info->type = p->conf.type;
-            info->owner = p->conf.owner;
-            info->subscriptions = p->state.subscription_list.size();
-            info->valueptr = p->state.valueptr;
-            return index++;
+            pp_fill_info(p, info);
+            return index + 1;
         }
         index++;
     }
     return -1;
 }
 
+pp_t pp_get_next(pp_cursor_t *cursor, pp_info_t *info)
+{
+    if (cursor == NULL || *cursor >= live_count)
+        return NULL;
+    public_parameter_t *p = live_list[(*cursor)++];
+    if (info != NULL)
+        pp_fill_info(p, info);
+    return pp_handle(p);
+}
+
+size_t pp_get_info_range(size_t start, pp_info_t *info, size_t max)
+{
+    if (info == NULL)
+        return 0;
+    size_t count = 0;
+    for (size_t i = start; i < live_count && count < max; i++)
+        pp_fill_info(live_list[i], &info[count++]);
+    return count;
+}
+
 void pp_enable(pp_t pp, bool enable)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    p->state.is_active = enable;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p != NULL)
+        p->state.is_active = enable;
 }
 
 bool pp_is_enabled(pp_t pp)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
-    return p->state.is_active;
+    public_parameter_t *p = pp_resolve(pp);
+    return p != NULL && p->state.is_active;
 }
 
 bool pp_set_context(pp_t pp, void *context)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
     p->state.context = context;
     return true;
 }
 
 void *pp_get_context(pp_t pp)
 {
-    public_parameter_t *p = (public_parameter_t *)pp;
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return NULL;
     return p->state.context;
 }
 
+void pp_internal_set_persistent(pp_t pp, bool persistent)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p != NULL)
+        p->state.persistent = persistent;
+}
+
+bool pp_internal_set_array_encoder(pp_t pp, pp_array_encoder_t *encoder, pp_array_encoder_t **old)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
+    xSemaphoreTake(array_lock, portMAX_DELAY);
+    bool ok = encoder == NULL || p->state.bridge_exports == 0;
+    if (ok)
+    {
+        *old = p->state.array_encoder;
+        p->state.array_encoder = encoder;
+    }
+    xSemaphoreGive(array_lock);
+    return ok;
+}
+
+bool pp_internal_get_array_encoding(pp_t pp, pp_array_encoding_t *encoding)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
+    xSemaphoreTake(array_lock, portMAX_DELAY);
+    bool ok = p->state.array_encoder != NULL && pp_array_encoder_config(p->state.array_encoder, encoding);
+    xSemaphoreGive(array_lock);
+    return ok;
+}
+
+bool pp_internal_set_bridge_export(pp_t pp, bool exported)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return false;
+    xSemaphoreTake(array_lock, portMAX_DELAY);
+    bool ok = !exported || (p->state.array_encoder == NULL && p->state.bridge_exports < UINT8_MAX);
+    if (ok && exported)
+        p->state.bridge_exports++;
+    else if (!exported && p->state.bridge_exports > 0)
+        p->state.bridge_exports--;
+    xSemaphoreGive(array_lock);
+    return ok;
+}
+
+void pp_internal_changed(pp_t pp)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p != NULL)
+        pp_changed(p, false, NULL, 0);
+}
+
 void pp_init_hooks(pp_hooks *h)
 {
     if (h == NULL)
@@ -722,11 +2579,154 @@ void pp_init_hooks(pp_hooks *h)
     hooks = *h;
 }
 
+/// @brief Header in front of allocations freed with pp_free(), 8 bytes to keep the alignment.
+typedef struct
+{
+    uint32_t size;
+    uint32_t category;
+} pp_mem_header_t;
+
+static void pp_mem_account(pp_mem_category_t category, size_t size, bool allocated)
+{
+    portENTER_CRITICAL(&memory_lock);
+    if (allocated)
+    {
+        memory_stats.current[category] += size;
+        memory_stats.total += size;
+        memory_stats.allocations++;
+        if (memory_stats.current[category] > memory_stats.peak[category])
+            memory_stats.peak[category] = memory_stats.current[category];
+        if (memory_stats.total > memory_stats.total_peak)
+            memory_stats.total_peak = memory_stats.total;
+    }
+    else
+    {
+        memory_stats.current[category] -= size;
+        memory_stats.total -= size;
+        memory_stats.allocations--;
+    }
+    portEXIT_CRITICAL(&memory_lock);
+}
+
+/// @brief Allocate from the arena. Permanent blocks may be larger than PP_ARENA_MAX_BLOCK, see pp_arena_free().
+static void *pp_arena_alloc(size_t size, bool permanent)
+{
+    if (arena.base == NULL || size == 0 || (size > PP_ARENA_MAX_BLOCK && !permanent))
+        return NULL;
+    size_t size_class = (size - 1) / ARENA_ALIGN;
+    void *ptr = NULL;
+    portENTER_CRITICAL(&memory_lock);
+    if (size_class < ARENA_CLASSES && arena.free_list[size_class] != NULL)
+    {
+        ptr = arena.free_list[size_class];
+        arena.free_list[size_class] = *(void **)ptr;
+    }
+    else if (arena.used + (size_class + 1) * ARENA_ALIGN <= arena.size)
+    {
+        ptr = arena.base + arena.used;
+        arena.used += (size_class + 1) * ARENA_ALIGN;
+    }
+    portEXIT_CRITICAL(&memory_lock);
+    return ptr;
+}
+
+/// @brief Return a block to its free list. Permanent blocks larger than PP_ARENA_MAX_BLOCK have no free list,
+/// they are only freed when pp_create fails and are given back if they are the last block handed out.
+/// @return False if the block is not in the arena.
+static bool pp_arena_free(void *ptr, size_t size)
+{
+    if ((uint8_t *)ptr < arena.base || (uint8_t *)ptr >= arena.base + arena.size)
+        return false;
+    size_t size_class = (size - 1) / ARENA_ALIGN;
+    portENTER_CRITICAL(&memory_lock);
+    if (size_class < ARENA_CLASSES)
+    {
+        *(void **)ptr = arena.free_list[size_class];
+        arena.free_list[size_class] = ptr;
+    }
+    else if ((uint8_t *)ptr + (size_class + 1) * ARENA_ALIGN == arena.base + arena.used)
+    {
+        arena.used -= (size_class + 1) * ARENA_ALIGN;
+    }
+    portEXIT_CRITICAL(&memory_lock);
+    return true;
+}
+
+void *pp_mem_alloc_sized(pp_mem_category_t category, size_t size)
+{
+    void *ptr = pp_arena_alloc(size, category == PP_MEM_STATIC);
+    if (ptr == NULL)
+        ptr = hooks.malloc_fn(size);
+    if (ptr == NULL)
+    {
+        portENTER_CRITICAL(&memory_lock);
+        memory_stats.failures++;
+        portEXIT_CRITICAL(&memory_lock);
+        return NULL;
+    }
+    pp_mem_account(category, size, true);
+    return ptr;
+}
+
+void pp_mem_free_sized(pp_mem_category_t category, void *ptr, size_t size)
+{
+    if (ptr == NULL)
+        return;
+    pp_mem_account(category, size, false);
+    if (!pp_arena_free(ptr, size))
+        hooks.free_fn(ptr);
+}
+
+bool pp_init_arena(void *region, size_t size)
+{
+    if (par_list != NULL || memory_stats.allocations > 0)
+    {
+        ESP_LOGE(TAG, "%s: The arena must be set before anything is created", __func__);
+        return false;
+    }
+    // Blocks are aligned to ARENA_ALIGN, skip the unaligned start of the region
+    size_t skip = (ARENA_ALIGN - ((uintptr_t)region % ARENA_ALIGN)) % ARENA_ALIGN;
+    if (region == NULL || size <= skip)
+        return false;
+    arena.base = (uint8_t *)region + skip;
+    arena.size = size - skip;
+    arena.used = 0;
+    memset(arena.free_list, 0, sizeof(arena.free_list));
+    return true;
+}
+
+void *pp_mem_alloc(pp_mem_category_t category, size_t size)
+{
+    pp_mem_header_t *header = (pp_mem_header_t *)pp_mem_alloc_sized(category, sizeof(pp_mem_header_t) + size);
+    if (header == NULL)
+        return NULL;
+    header->size = sizeof(pp_mem_header_t) + size;
+    header->category = category;
+    return header + 1;
+}
+
 void pp_free(void *ptr)
 {
     if (ptr == NULL)
         return;
-    hooks.free_fn(ptr);
+    pp_mem_header_t *header = (pp_mem_header_t *)ptr - 1;
+    pp_mem_free_sized((pp_mem_category_t)header->category, header, header->size);
+}
+
+bool pp_get_memory_stats(pp_memory_stats_t *stats)
+{
+    if (stats == NULL)
+        return false;
+    portENTER_CRITICAL(&memory_lock);
+    *stats = memory_stats;
+    portEXIT_CRITICAL(&memory_lock);
+    stats->current[PP_MEM_STATIC] += sizeof(write_slots);
+    stats->peak[PP_MEM_STATIC] += sizeof(write_slots);
+    stats->total += sizeof(write_slots);
+    stats->total_peak += sizeof(write_slots);
+    stats->arena_size = arena.size;
+    stats->arena_used = arena.used;
+    return true;
 }
 
 size_t pp_get_parameter_count(void)
@@ -734,19 +2734,20 @@ size_t pp_get_parameter_count(void)
     return nameToPP.size();
 }
 
-bool pp_get_parameter_list_as_json(char **buf, parameter_type_t type)
+/// @brief Build a JSON array with the names of the parameters in a range of the name map.
+static bool pp_list_as_json(pp_name_map_t::iterator begin, pp_name_map_t::iterator end, char **buf, parameter_type_t type)
 {
     if (buf == NULL)
         return false;
 
-    // Go through all parameters and find the length of all the names
+    // Go through the parameters and find the length of all the names
     size_t totalNameLength = 0;
-    for (auto it = nameToPP.begin(); it != nameToPP.end(); it++)
+    for (auto it = begin; it != end; it++)
     {
-        totalNameLength += strlen(it->first.c_str()) + 3; // 2 for quotes and 1 for comma
+        totalNameLength += strlen(it->first) + 3; // 2 for quotes and 1 for comma
     }
     totalNameLength += 2; // 2 for brackets
-    char *json = (char *)hooks.malloc_fn(totalNameLength);
+    char *json = (char *)pp_mem_alloc(PP_MEM_BUFFERS, totalNameLength);
     if (json == NULL)
     {
         ESP_LOGE(TAG, "%s: Failed to allocate memory for json", __func__);
@@ -756,7 +2757,7 @@ bool pp_get_parameter_list_as_json(char **buf, parameter_type_t type)
     size_t len = 0;
     json[len++] = '[';
     const char *comma = NULL;
-    for (auto it = nameToPP.begin(); it != nameToPP.end(); it++)
+    for (auto it = begin; it != end; it++)
     {
         public_parameter_t *p = it->second;
         if (!(p->conf.type & type))
@@ -765,9 +2766,9 @@ bool pp_get_parameter_list_as_json(char **buf, parameter_type_t type)
         if (comma != NULL)
             json[len++] = ',';
         comma = ",";
-        size_t nameLen = strlen(it->first.c_str());
+        size_t nameLen = strlen(it->first);
         json[len++] = '"';
-        memcpy(&json[len], it->first.c_str(), nameLen);
+        memcpy(&json[len], it->first, nameLen);
         len += nameLen;
         json[len++] = '"';
     }
@@ -776,3 +2777,142 @@ bool pp_get_parameter_list_as_json(char **buf, parameter_type_t type)
     *buf = json;
     return true;
 }
+
+bool pp_get_parameter_list_as_json(char **buf, parameter_type_t type)
+{
+    return pp_list_as_json(nameToPP.begin(), nameToPP.end(), buf, type);
+}
+
+bool pp_get_group_list_as_json(const char *group, char **buf, parameter_type_t type)
+{
+    pp_name_map_t::iterator begin, end;
+    if (!pp_group_range(group, &begin, &end))
+        return false;
+    return pp_list_as_json(begin, end, buf, type);
+}
+
+size_t pp_get_group(const char *group, pp_t *list, size_t max)
+{
+    pp_name_map_t::iterator begin, end;
+    if (!pp_group_range(group, &begin, &end))
+        return 0;
+    size_t count = 0;
+    for (auto it = begin; it != end; it++, count++)
+    {
+        if (list != NULL && count < max)
+            list[count] = pp_handle(it->second);
+    }
+    return count;
+}
+
+bool pp_set_meta(pp_t pp, const pp_meta_t *meta)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL || meta == NULL)
+        return false;
+    if ((meta->flags & PP_META_ENUM) && (meta->enum_values == NULL || meta->enum_count == 0))
+    {
+        ESP_LOGW(TAG, "%s: %s enum without values", __func__, p->conf.name);
+        return false;
+    }
+    if ((meta->flags & PP_META_RANGE) && meta->min > meta->max)
+    {
+        ESP_LOGW(TAG, "%s: %s min is above max", __func__, p->conf.name);
+        return false;
+    }
+    p->conf.meta = *meta;
+    return true;
+}
+
+const pp_meta_t *pp_get_meta(pp_t pp)
+{
+    public_parameter_t *p = pp_resolve(pp);
+    if (p == NULL)
+        return NULL;
+    return &p->conf.meta;
+}
+
+static const char *pp_type_name(parameter_type_t type)
+{
+    switch (type & TYPE_ALL)
+    {
+    case TYPE_INT32:
+        return "int32";
+    case TYPE_INT64:
+        return "int64";
+    case TYPE_FLOAT:
+        return "float";
+    case TYPE_BOOL:
+        return "bool";
+    case TYPE_FLOAT_ARRAY:
+        return "float_array";
+    case TYPE_INT16_ARRAY:
+        return "int16_array";
+    case TYPE_EXECUTE:
+        return "execute";
+    case TYPE_STRING:
+        return "string";
+    case TYPE_BINARY:
+        return "binary";
+    default:
+        return "unknown";
+    }
+}
+
+/// @brief Write one parameter with its metadata as a JSON object.
+/// @return The length of the object, like snprintf, also when buf is NULL.
+static size_t pp_meta_json(const public_parameter_t *p, char *buf, size_t bufsize)
+{
+    const pp_meta_t *m = &p->conf.meta;
+    size_t len = snprintf(buf, bufsize, "{\"name\":\"%s\",\"type\":\"%s\"", p->conf.name, pp_type_name(p->conf.type));
+#define PP_META_APPEND(...) len += snprintf(buf ? buf + len : NULL, buf ? bufsize - len : 0, __VA_ARGS__)
+    if (m->flags & PP_META_READ_ONLY)
+        PP_META_APPEND(",\"read_only\":true");
+    if (m->flags & PP_META_RANGE)
+        PP_META_APPEND(",\"min\":%g,\"max\":%g", m->min, m->max);
+    if (m->flags & PP_META_STEP)
+        PP_META_APPEND(",\"step\":%g", m->step);
+    if (m->flags & PP_META_MAX_LEN)
+        PP_META_APPEND(",\"max_len\":%d", m->max_len);
+    if (m->flags & PP_META_ENUM)
+    {
+        for (size_t i = 0; i < m->enum_count; i++)
+            PP_META_APPEND("%s%li", i == 0 ? ",\"enum\":[" : ",", m->enum_values[i]);
+        PP_META_APPEND("]");
+    }
+    PP_META_APPEND("}");
+#undef PP_META_APPEND
+    return len;
+}
+
+bool pp_get_group_meta_as_json(const char *group, char **buf, parameter_type_t type)
+{
+    pp_name_map_t::iterator begin, end;
+    if (buf == NULL || !pp_group_range(group, &begin, &end))
+        return false;
+
+    size_t total = 3; // brackets and terminator
+    for (auto it = begin; it != end; it++)
+        if (it->second->conf.type & type)
+            total += pp_meta_json(it->second, NULL, 0) + 1; // 1 for comma
+    char *json = (char *)pp_mem_alloc(PP_MEM_BUFFERS, total);
+    if (json == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate memory for json", __func__);
+        return false;
+    }
+    size_t len = 0;
+    json[len++] = '[';
+    for (auto it = begin; it != end; it++)
+    {
+        if (!(it->second->conf.type & type))
+            continue;
+        if (len > 1)
+            json[len++] = ',';
+        len += pp_meta_json(it->second, &json[len], total - len);
+    }
+    json[len++] = ']';
+    json[len] = 0;
+    *buf = json;
+    return true;
+}
@@ -0,0 +1,233 @@
+#include <string.h>
+#include <math.h>
+#include <esp_log.h>
+#include "pp.h"
+#include "pp_array.h"
+#include "pp_internal.h"
+
+struct pp_array_encoder_t
+{
+    pp_array_encoding_t config;
+    uint32_t sequence;
+    uint32_t since_keyframe;
+    /// @brief Subscribers at the last frame, a new subscriber needs a keyframe.
+    size_t subscribers;
+    /// @brief The array as the decoders have it, PP_ARRAY_SPARSE only.
+    float *reference;
+    size_t len;
+};
+
+static const char *TAG = "PP_ARRAY";
+
+/// @brief Offset of the floats in a sparse frame, after the indices padded to 4 bytes.
+static size_t array_sparse_values_offset(size_t count)
+{
+    return sizeof(pp_array_frame_t) + ((count * sizeof(uint16_t) + 3) & ~(size_t)3);
+}
+
+static pp_array_frame_t *array_frame_alloc(pp_array_encoder_t *encoder, size_t size, size_t len, size_t count, bool keyframe)
+{
+    pp_array_frame_t *frame = (pp_array_frame_t *)pp_mem_alloc_sized(PP_MEM_EVENTS, size);
+    if (frame == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate %d bytes", __func__, size);
+        return NULL;
+    }
+    memset(frame, 0, sizeof(pp_array_frame_t));
+    frame->kind = encoder->config.kind;
+    frame->keyframe = keyframe ? 1 : 0;
+    frame->count = count;
+    frame->sequence = ++encoder->sequence;
+    frame->len = len;
+    frame->scale = encoder->config.scale;
+    frame->offset = encoder->config.offset;
+    return frame;
+}
+
+static void *array_encode_int16(pp_array_encoder_t *encoder, const pp_float_array_t *array, size_t *size)
+{
+    *size = sizeof(pp_array_frame_t) + array->len * sizeof(int16_t);
+    pp_array_frame_t *frame = array_frame_alloc(encoder, *size, array->len, array->len, true);
+    if (frame == NULL)
+        return NULL;
+    int16_t *q = (int16_t *)(frame + 1);
+    float inverse = 1.0f / encoder->config.scale;
+    for (size_t i = 0; i < array->len; i++)
+    {
+        // Clamp before rounding, lrintf() of NaN or of a value out of range is unspecified
+        float v = (array->data[i] - encoder->config.offset) * inverse;
+        if (isnan(v))
+            q[i] = PP_ARRAY_INT16_NAN;
+        else
+            q[i] = (v >= INT16_MAX) ? INT16_MAX : (v <= INT16_MIN + 1) ? INT16_MIN + 1 : (int16_t)lrintf(v);
+    }
+    return frame;
+}
+
+static void *array_encode_sparse(pp_array_encoder_t *encoder, const pp_float_array_t *array, size_t subscribers, size_t *size)
+{
+    if (array->len != encoder->len)
+    {
+        pp_mem_free_sized(PP_MEM_MODULES, encoder->reference, encoder->len * sizeof(float));
+        encoder->len = 0;
+        encoder->reference = (float *)pp_mem_alloc_sized(PP_MEM_MODULES, array->len * sizeof(float));
+        if (encoder->reference == NULL)
+        {
+            ESP_LOGE(TAG, "%s: Failed to allocate the reference of %d floats", __func__, array->len);
+            return NULL;
+        }
+        encoder->len = array->len;
+        encoder->since_keyframe = encoder->config.keyframe_interval;
+    }
+
+    // A keyframe when it is due, for a new subscriber, or when it is not larger than the changes
+    bool keyframe = encoder->since_keyframe >= encoder->config.keyframe_interval || subscribers > encoder->subscribers;
+    encoder->subscribers = subscribers;
+    size_t changed = 0;
+    if (!keyframe)
+    {
+        for (size_t i = 0; i < array->len; i++)
+            if (!(fabsf(array->data[i] - encoder->reference[i]) <= encoder->config.threshold))
+                changed++;
+        keyframe = array_sparse_values_offset(changed) + changed * sizeof(float) >= sizeof(pp_array_frame_t) + array->len * sizeof(float);
+    }
+
+    pp_array_frame_t *frame;
+    if (keyframe)
+    {
+        *size = sizeof(pp_array_frame_t) + array->len * sizeof(float);
+        frame = array_frame_alloc(encoder, *size, array->len, array->len, true);
+        if (frame == NULL)
+            return NULL;
+        memcpy(frame + 1, array->data, array->len * sizeof(float));
+        memcpy(encoder->reference, array->data, array->len * sizeof(float));
+        encoder->since_keyframe = 1;
+        return frame;
+    }
+
+    *size = array_sparse_values_offset(changed) + changed * sizeof(float);
+    frame = array_frame_alloc(encoder, *size, array->len, changed, false);
+    if (frame == NULL)
+        return NULL;
+    uint16_t *indices = (uint16_t *)(frame + 1);
+    float *values = (float *)((uint8_t *)frame + array_sparse_values_offset(changed));
+    size_t n = 0;
+    for (size_t i = 0; i < array->len; i++)
+    {
+        if (fabsf(array->data[i] - encoder->reference[i]) <= encoder->config.threshold)
+            continue;
+        // The reference only follows what is sent, so unsent changes never add up beyond the threshold
+        encoder->reference[i] = array->data[i];
+        indices[n] = i;
+        values[n] = array->data[i];
+        n++;
+    }
+    encoder->since_keyframe++;
+    return frame;
+}
+
+void *pp_array_encode(pp_array_encoder_t *encoder, const pp_float_array_t *array, size_t subscribers, size_t *size)
+{
+    if (array->len > UINT16_MAX)
+        return NULL;
+    switch (encoder->config.kind)
+    {
+    case PP_ARRAY_INT16:
+        return array_encode_int16(encoder, array, size);
+    case PP_ARRAY_SPARSE:
+        return array_encode_sparse(encoder, array, subscribers, size);
+    default:
+        return NULL;
+    }
+}
+
+void pp_array_encoder_free(pp_array_encoder_t *encoder)
+{
+    if (encoder == NULL)
+        return;
+    pp_mem_free_sized(PP_MEM_MODULES, encoder->reference, encoder->len * sizeof(float));
+    pp_mem_delete(PP_MEM_MODULES, encoder);
+}
+
+bool pp_array_encoder_config(const pp_array_encoder_t *encoder, pp_array_encoding_t *encoding)
+{
+    *encoding = encoder->config;
+    return true;
+}
+
+bool pp_set_array_encoding(pp_t pp, const pp_array_encoding_t *encoding)
+{
+    if ((pp_get_type(pp) & TYPE_ALL) != TYPE_FLOAT_ARRAY)
+    {
+        ESP_LOGE(TAG, "%s: %s is not a float array parameter", __func__, pp_get_name(pp));
+        return false;
+    }
+    pp_array_encoder_t *encoder = NULL;
+    if (encoding != NULL && encoding->kind != PP_ARRAY_RAW)
+    {
+        if (encoding->kind == PP_ARRAY_INT16 && encoding->scale == 0.0f)
+        {
+            ESP_LOGE(TAG, "%s: Scale of %s is 0", __func__, pp_get_name(pp));
+            return false;
+        }
+        if (encoding->kind != PP_ARRAY_INT16 && encoding->kind != PP_ARRAY_SPARSE)
+            return false;
+        encoder = pp_mem_new<pp_array_encoder_t>(PP_MEM_MODULES);
+        if (encoder == NULL)
+        {
+            ESP_LOGE(TAG, "%s: Failed to allocate the encoder of %s", __func__, pp_get_name(pp));
+            return false;
+        }
+        encoder->config = *encoding;
+        if (encoder->config.keyframe_interval == 0)
+            encoder->config.keyframe_interval = PP_ARRAY_DEFAULT_KEYFRAME_INTERVAL;
+    }
+    pp_array_encoder_t *old = NULL;
+    if (!pp_internal_set_array_encoder(pp, encoder, &old))
+    {
+        ESP_LOGE(TAG, "%s: %s is exported by a bridge, it can not be encoded", __func__, pp_get_name(pp));
+        pp_array_encoder_free(encoder);
+        return false;
+    }
+    pp_array_encoder_free(old);
+    return true;
+}
+
+pp_array_encoding_kind_t pp_get_array_encoding(pp_t pp)
+{
+    pp_array_encoding_t encoding;
+    return pp_internal_get_array_encoding(pp, &encoding) ? encoding.kind : PP_ARRAY_RAW;
+}
+
+bool pp_array_decode(const pp_array_frame_t *frame, pp_float_array_t *out, size_t capacity, uint32_t *sequence)
+{
+    if (frame == NULL || out == NULL || sequence == NULL || frame->len > capacity)
+        return false;
+
+    if (frame->kind == PP_ARRAY_INT16)
+    {
+        const int16_t *q = (const int16_t *)(frame + 1);
+        for (size_t i = 0; i < frame->len; i++)
+            out->data[i] = (q[i] == PP_ARRAY_INT16_NAN) ? NAN : frame->offset + q[i] * frame->scale;
+    }
+    else if (frame->kind == PP_ARRAY_SPARSE && frame->keyframe)
+    {
+        memcpy(out->data, frame + 1, frame->len * sizeof(float));
+    }
+    else if (frame->kind == PP_ARRAY_SPARSE)
+    {
+        // Changes only apply to the frame before, otherwise wait for a keyframe
+        if (*sequence == 0 || frame->sequence != *sequence + 1 || out->len != frame->len)
+            return false;
+        const uint16_t *indices = (const uint16_t *)(frame + 1);
+        const float *values = (const float *)((const uint8_t *)frame + array_sparse_values_offset(frame->count));
+        for (size_t i = 0; i < frame->count; i++)
+            if (indices[i] < frame->len)
+                out->data[indices[i]] = values[i];
+    }
+    else
+        return false;
+    out->len = frame->len;
+    *sequence = frame->sequence;
+    return true;
+}
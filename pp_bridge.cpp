@@ -0,0 +1,669 @@
+#include <string>
+#include <string.h>
+#include <map>
+#include <list>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <esp_log.h>
+#include "pp.h"
+#include "pp_bridge.h"
+#include "pp_internal.h"
+
+// Frame: magic (2), type (1), payload length (2, little endian), payload, checksum (1)
+#define FRAME_MAGIC0 0xA5
+#define FRAME_MAGIC1 0x5A
+#define FRAME_HEADER_SIZE 5
+#define FRAME_OVERHEAD (FRAME_HEADER_SIZE + 1)
+
+// DESCRIBE payload: id (2), type (2), name length (1), name
+// UPDATE payload: one or more of id (2), size (2), value
+// WRITE payload: id (2), size (2), value
+// Scalars are sent as they are in memory, strings with their terminator, float arrays as their
+// length (2) followed by the floats. Sizes that do not match the type are refused.
+#define FRAME_DESCRIBE 1
+#define FRAME_UPDATE 2
+#define FRAME_WRITE 3
+
+#define ENTRY_HEADER_SIZE 4
+#define MAX_VALUE_SIZE (PP_BRIDGE_MAX_FRAME - ENTRY_HEADER_SIZE)
+#define ARRAY_LEN_SIZE 2
+#define MAX_ARRAY_LEN ((MAX_VALUE_SIZE - ARRAY_LEN_SIZE) / sizeof(float))
+
+typedef std::vector<uint8_t, pp_allocator<uint8_t, PP_MEM_MODULES>> bridge_bytes_t;
+typedef pp_string<PP_MEM_MODULES> bridge_string_t;
+
+typedef struct
+{
+    pp_bridge_t *bridge;
+    pp_t pp;
+    uint16_t id;
+    parameter_type_t type;
+    bool described;
+    bool dirty;
+    bridge_bytes_t value; ///< Latest value.
+    bridge_bytes_t sent;  ///< Value last sent to the remote.
+} bridge_export_t;
+
+typedef struct
+{
+    pp_bridge_t *bridge;
+    pp_t pp;
+    uint16_t remote_id;
+    parameter_type_t type;
+    bridge_string_t name;
+    /// @brief Value of the proxy, the value pointer points here. Arrays are kept as a pp_float_array_t.
+    union
+    {
+        pp_value_t scalar;
+        pp_float_array_t array;
+        uint8_t buffer[MAX_VALUE_SIZE + sizeof(size_t)];
+    } value;
+} bridge_proxy_t;
+
+struct pp_bridge_t
+{
+    pp_bridge_transport_t transport;
+    pp_evloop_t evloop;
+    bridge_string_t prefix;
+    std::vector<bridge_export_t *, pp_allocator<bridge_export_t *, PP_MEM_MODULES>> exports;
+    std::map<uint16_t, bridge_proxy_t *, std::less<uint16_t>, pp_allocator<std::pair<const uint16_t, bridge_proxy_t *>, PP_MEM_MODULES>> proxies;
+    uint8_t frame[PP_BRIDGE_MAX_FRAME];
+    uint8_t tx[PP_BRIDGE_BUFFER_SIZE];
+    size_t tx_len;
+    uint8_t rx[PP_BRIDGE_BUFFER_SIZE];
+    size_t rx_len;
+};
+
+typedef std::list<bridge_export_t *, pp_allocator<bridge_export_t *, PP_MEM_MODULES>> bridge_export_list_t;
+static std::map<pp_t, bridge_export_list_t, std::less<pp_t>, pp_allocator<std::pair<const pp_t, bridge_export_list_t>, PP_MEM_MODULES>> exports_by_pp;
+static std::map<pp_t, bridge_proxy_t *, std::less<pp_t>, pp_allocator<std::pair<const pp_t, bridge_proxy_t *>, PP_MEM_MODULES>> proxies_by_pp;
+
+static const char *TAG = "PP_BRIDGE";
+
+static uint8_t bridge_checksum(const uint8_t *data, size_t len)
+{
+    uint8_t sum = 0;
+    for (size_t i = 0; i < len; i++)
+        sum += data[i];
+    return ~sum;
+}
+
+static size_t bridge_scalar_size(parameter_type_t type)
+{
+    switch (type & TYPE_ALL)
+    {
+    case TYPE_INT32:
+        return sizeof(int32_t);
+    case TYPE_INT64:
+        return sizeof(int64_t);
+    case TYPE_FLOAT:
+        return sizeof(float);
+    case TYPE_BOOL:
+        return sizeof(bool);
+    default:
+        return 0;
+    }
+}
+
+static void bridge_put_u16(uint8_t *buf, uint16_t value)
+{
+    buf[0] = value & 0xFF;
+    buf[1] = value >> 8;
+}
+
+static uint16_t bridge_get_u16(const uint8_t *buf)
+{
+    return buf[0] | (buf[1] << 8);
+}
+
+/// @brief Convert a value as posted to its wire format.
+/// @return False if the value is too large to be sent.
+static bool bridge_encode_value(parameter_type_t type, const void *data, bridge_bytes_t *out)
+{
+    size_t size = bridge_scalar_size(type);
+    if (size > 0)
+    {
+        out->assign((const uint8_t *)data, (const uint8_t *)data + size);
+        return true;
+    }
+    switch (type & TYPE_ALL)
+    {
+    case TYPE_STRING:
+        size = strnlen((const char *)data, MAX_VALUE_SIZE) + 1;
+        if (size > MAX_VALUE_SIZE)
+            return false;
+        out->assign((const uint8_t *)data, (const uint8_t *)data + size);
+        return true;
+    case TYPE_FLOAT_ARRAY:
+    {
+        const pp_float_array_t *array = (const pp_float_array_t *)data;
+        if (array->len > MAX_ARRAY_LEN)
+            return false;
+        out->resize(ARRAY_LEN_SIZE + array->len * sizeof(float));
+        bridge_put_u16(out->data(), array->len);
+        memcpy(out->data() + ARRAY_LEN_SIZE, array->data, array->len * sizeof(float));
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+/// @brief Check that a received value has the size its type needs.
+static bool bridge_value_valid(parameter_type_t type, const uint8_t *value, size_t size)
+{
+    size_t scalar = bridge_scalar_size(type);
+    if (scalar > 0)
+        return size == scalar;
+    switch (type & TYPE_ALL)
+    {
+    case TYPE_STRING:
+        return size > 0 && size <= MAX_VALUE_SIZE;
+    case TYPE_FLOAT_ARRAY:
+        return size >= ARRAY_LEN_SIZE && bridge_get_u16(value) <= MAX_ARRAY_LEN &&
+               size == ARRAY_LEN_SIZE + bridge_get_u16(value) * sizeof(float);
+    default:
+        return false;
+    }
+}
+
+/// @brief Queue a frame for sending.
+/// @return False if there is no room, the frame is not queued.
+static bool bridge_queue_frame(pp_bridge_t *b, uint8_t type, const uint8_t *payload, size_t len)
+{
+    if (b->tx_len + len + FRAME_OVERHEAD > sizeof(b->tx))
+        return false;
+    uint8_t *frame = &b->tx[b->tx_len];
+    frame[0] = FRAME_MAGIC0;
+    frame[1] = FRAME_MAGIC1;
+    frame[2] = type;
+    bridge_put_u16(&frame[3], len);
+    memcpy(&frame[FRAME_HEADER_SIZE], payload, len);
+    frame[FRAME_HEADER_SIZE + len] = bridge_checksum(&frame[2], len + 3);
+    b->tx_len += len + FRAME_OVERHEAD;
+    return true;
+}
+
+static bool bridge_flush(pp_bridge_t *b)
+{
+    while (b->tx_len > 0)
+    {
+        int n = b->transport.write(b->transport.ctx, b->tx, b->tx_len);
+        if (n < 0)
+            return false;
+        if (n == 0)
+            break;
+        memmove(b->tx, &b->tx[n], b->tx_len - n);
+        b->tx_len -= n;
+    }
+    return true;
+}
+
+static void bridge_newstate_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    auto it = exports_by_pp.find((pp_t)arg);
+    if (it == exports_by_pp.end())
+        return;
+    for (auto ite = it->second.begin(); ite != it->second.end(); ite++)
+    {
+        bridge_export_t *e = *ite;
+        if (!bridge_encode_value(e->type, event_data, &e->value))
+        {
+            ESP_LOGW(TAG, "%s: %s value is too large to be sent", __func__, pp_get_name(e->pp));
+            continue;
+        }
+        e->dirty = (e->value != e->sent);
+    }
+}
+
+/// @brief Write callback of proxies, sends the write to the node owning the parameter.
+static void bridge_proxy_write_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    auto it = proxies_by_pp.find((pp_t)arg);
+    if (it == proxies_by_pp.end())
+        return;
+    bridge_proxy_t *proxy = it->second;
+    pp_bridge_t *b = proxy->bridge;
+    bridge_bytes_t value;
+    if (!bridge_encode_value(proxy->type, event_data, &value))
+        return;
+    bridge_put_u16(&b->frame[0], proxy->remote_id);
+    bridge_put_u16(&b->frame[2], value.size());
+    memcpy(&b->frame[ENTRY_HEADER_SIZE], value.data(), value.size());
+    if (!bridge_queue_frame(b, FRAME_WRITE, b->frame, ENTRY_HEADER_SIZE + value.size()))
+    {
+        ESP_LOGW(TAG, "%s: Transport full, write to %s dropped", __func__, proxy->name.c_str());
+        pp_write_reject(proxy->pp);
+    }
+}
+
+static void bridge_handle_describe(pp_bridge_t *b, const uint8_t *payload, size_t len)
+{
+    if (len < 5 || len < 5u + payload[4])
+        return;
+    uint16_t id = bridge_get_u16(&payload[0]);
+    parameter_type_t type = (parameter_type_t)bridge_get_u16(&payload[2]);
+    bridge_string_t name = b->prefix + bridge_string_t((const char *)&payload[5], payload[4]);
+    auto it = b->proxies.find(id);
+    if (it != b->proxies.end())
+    {
+        if (it->second->name == name && it->second->type == type)
+            return;
+        ESP_LOGW(TAG, "%s: remote id %d changed from %s to %s", __func__, id, it->second->name.c_str(), name.c_str());
+        return;
+    }
+
+    bridge_proxy_t *proxy = pp_mem_new<bridge_proxy_t>(PP_MEM_MODULES);
+    if (proxy == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate proxy for %s", __func__, name.c_str());
+        return;
+    }
+    proxy->bridge = b;
+    proxy->remote_id = id;
+    proxy->type = type;
+    proxy->name = name;
+    const char *n = proxy->name.c_str();
+    switch (type)
+    {
+    case TYPE_INT32:
+        proxy->pp = pp_create_int32(n, &b->evloop, bridge_proxy_write_event, &proxy->value.scalar.i32);
+        break;
+    case TYPE_INT64:
+        proxy->pp = pp_create_int64(n, &b->evloop, bridge_proxy_write_event, &proxy->value.scalar.i64);
+        break;
+    case TYPE_FLOAT:
+        proxy->pp = pp_create_float(n, &b->evloop, bridge_proxy_write_event, &proxy->value.scalar.f);
+        break;
+    case TYPE_BOOL:
+        proxy->pp = pp_create_bool(n, &b->evloop, bridge_proxy_write_event, &proxy->value.scalar.b);
+        break;
+    case TYPE_STRING:
+        proxy->pp = pp_create_string(n, &b->evloop, bridge_proxy_write_event);
+        break;
+    case TYPE_FLOAT_ARRAY:
+        proxy->pp = pp_create_float_array(n, &b->evloop, NULL);
+        break;
+    default:
+        proxy->pp = NULL;
+        break;
+    }
+    // An existing parameter with the same name is returned as is, it is not ours
+    if (proxy->pp == NULL || pp_get_owner(proxy->pp) != &b->evloop || proxies_by_pp.count(proxy->pp) != 0)
+    {
+        ESP_LOGE(TAG, "%s: Failed to create proxy %s", __func__, name.c_str());
+        pp_mem_delete(PP_MEM_MODULES, proxy);
+        return;
+    }
+    if (type == TYPE_STRING || type == TYPE_FLOAT_ARRAY)
+        pp_set_valueptr(proxy->pp, proxy->value.buffer);
+    b->proxies[id] = proxy;
+    proxies_by_pp[proxy->pp] = proxy;
+}
+
+static void bridge_handle_update(pp_bridge_t *b, const uint8_t *payload, size_t len)
+{
+    size_t offset = 0;
+    while (offset + ENTRY_HEADER_SIZE <= len)
+    {
+        uint16_t id = bridge_get_u16(&payload[offset]);
+        size_t size = bridge_get_u16(&payload[offset + 2]);
+        const uint8_t *value = &payload[offset + ENTRY_HEADER_SIZE];
+        offset += ENTRY_HEADER_SIZE + size;
+        if (offset > len)
+            break;
+        auto it = b->proxies.find(id);
+        if (it == b->proxies.end())
+            continue;
+        bridge_proxy_t *proxy = it->second;
+        if (!bridge_value_valid(proxy->type, value, size))
+        {
+            ESP_LOGW(TAG, "%s: %s update of %d bytes refused", __func__, proxy->name.c_str(), size);
+            continue;
+        }
+        if (proxy->type == TYPE_FLOAT_ARRAY)
+        {
+            proxy->value.array.len = bridge_get_u16(value);
+            memcpy(proxy->value.array.data, value + ARRAY_LEN_SIZE, size - ARRAY_LEN_SIZE);
+        }
+        else
+            memcpy(proxy->value.buffer, value, size);
+        switch (proxy->type)
+        {
+        case TYPE_INT32:
+            pp_post_newstate_int32(proxy->pp, proxy->value.scalar.i32);
+            break;
+        case TYPE_INT64:
+            pp_post_newstate_int64(proxy->pp, proxy->value.scalar.i64);
+            break;
+        case TYPE_FLOAT:
+            pp_post_newstate_float(proxy->pp, proxy->value.scalar.f);
+            break;
+        case TYPE_BOOL:
+            pp_post_newstate_bool(proxy->pp, proxy->value.scalar.b);
+            break;
+        case TYPE_STRING:
+            proxy->value.buffer[size] = 0;
+            pp_post_newstate_string(proxy->pp, (const char *)proxy->value.buffer);
+            break;
+        case TYPE_FLOAT_ARRAY:
+            pp_post_newstate_float_array(proxy->pp, &proxy->value.array);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+static void bridge_handle_write(pp_bridge_t *b, const uint8_t *payload, size_t len)
+{
+    if (len < ENTRY_HEADER_SIZE)
+        return;
+    uint16_t id = bridge_get_u16(&payload[0]);
+    size_t size = bridge_get_u16(&payload[2]);
+    if (id >= b->exports.size() || ENTRY_HEADER_SIZE + size > len)
+        return;
+    bridge_export_t *e = b->exports[id];
+    if (!bridge_value_valid(e->type, &payload[ENTRY_HEADER_SIZE], size))
+    {
+        ESP_LOGW(TAG, "%s: %s write of %d bytes refused", __func__, pp_get_name(e->pp), size);
+        return;
+    }
+    pp_value_t value = {};
+    memcpy(&value, &payload[ENTRY_HEADER_SIZE], size < sizeof(value) ? size : sizeof(value));
+    switch (e->type)
+    {
+    case TYPE_INT32:
+        pp_post_write_int32(e->pp, value.i32);
+        break;
+    case TYPE_INT64:
+        pp_post_write_int64(e->pp, value.i64);
+        break;
+    case TYPE_FLOAT:
+        pp_post_write_float(e->pp, value.f);
+        break;
+    case TYPE_BOOL:
+        pp_post_write_bool(e->pp, value.b);
+        break;
+    case TYPE_STRING:
+    {
+        bridge_string_t str((const char *)&payload[ENTRY_HEADER_SIZE], strnlen((const char *)&payload[ENTRY_HEADER_SIZE], size));
+        pp_post_write_string(e->pp, str.c_str());
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static void bridge_receive(pp_bridge_t *b)
+{
+    size_t offset = 0;
+    while (b->rx_len - offset >= FRAME_OVERHEAD)
+    {
+        const uint8_t *frame = &b->rx[offset];
+        if (frame[0] != FRAME_MAGIC0 || frame[1] != FRAME_MAGIC1)
+        {
+            offset++;
+            continue;
+        }
+        size_t len = bridge_get_u16(&frame[3]);
+        if (len > PP_BRIDGE_MAX_FRAME)
+        {
+            offset++;
+            continue;
+        }
+        if (b->rx_len - offset < len + FRAME_OVERHEAD)
+            break;
+        if (frame[FRAME_HEADER_SIZE + len] != bridge_checksum(&frame[2], len + 3))
+        {
+            ESP_LOGW(TAG, "%s: Checksum error", __func__);
+            offset++;
+            continue;
+        }
+        switch (frame[2])
+        {
+        case FRAME_DESCRIBE:
+            bridge_handle_describe(b, &frame[FRAME_HEADER_SIZE], len);
+            break;
+        case FRAME_UPDATE:
+            bridge_handle_update(b, &frame[FRAME_HEADER_SIZE], len);
+            break;
+        case FRAME_WRITE:
+            bridge_handle_write(b, &frame[FRAME_HEADER_SIZE], len);
+            break;
+        default:
+            break;
+        }
+        offset += len + FRAME_OVERHEAD;
+    }
+    memmove(b->rx, &b->rx[offset], b->rx_len - offset);
+    b->rx_len -= offset;
+}
+
+/// @brief Queue describe frames, then as many changed values as fit in update frames.
+static void bridge_send_changes(pp_bridge_t *b)
+{
+    for (auto it = b->exports.begin(); it != b->exports.end(); it++)
+    {
+        bridge_export_t *e = *it;
+        if (e->described)
+            continue;
+        const char *name = pp_get_name(e->pp);
+        size_t name_len = strnlen(name, MAX_PAR_NAME);
+        bridge_put_u16(&b->frame[0], e->id);
+        bridge_put_u16(&b->frame[2], e->type);
+        b->frame[4] = name_len;
+        memcpy(&b->frame[5], name, name_len);
+        if (!bridge_queue_frame(b, FRAME_DESCRIBE, b->frame, 5 + name_len))
+            return;
+        e->described = true;
+    }
+
+    // Frames are sized to fit in the tx buffer, so an entry added to a frame is always sent
+    size_t len = 0;
+    size_t limit = sizeof(b->tx) - b->tx_len;
+    limit = (limit > FRAME_OVERHEAD) ? limit - FRAME_OVERHEAD : 0;
+    if (limit > sizeof(b->frame))
+        limit = sizeof(b->frame);
+    for (auto it = b->exports.begin(); it != b->exports.end(); it++)
+    {
+        bridge_export_t *e = *it;
+        if (!e->dirty)
+            continue;
+        if (len + ENTRY_HEADER_SIZE + e->value.size() > limit)
+        {
+            if (len == 0)
+                return;
+            bridge_queue_frame(b, FRAME_UPDATE, b->frame, len);
+            len = 0;
+            limit = sizeof(b->tx) - b->tx_len;
+            limit = (limit > FRAME_OVERHEAD) ? limit - FRAME_OVERHEAD : 0;
+            if (limit > sizeof(b->frame))
+                limit = sizeof(b->frame);
+            if (ENTRY_HEADER_SIZE + e->value.size() > limit)
+                return;
+        }
+        bridge_put_u16(&b->frame[len], e->id);
+        bridge_put_u16(&b->frame[len + 2], e->value.size());
+        memcpy(&b->frame[len + ENTRY_HEADER_SIZE], e->value.data(), e->value.size());
+        len += ENTRY_HEADER_SIZE + e->value.size();
+        e->sent = e->value;
+        e->dirty = false;
+    }
+    if (len > 0)
+        bridge_queue_frame(b, FRAME_UPDATE, b->frame, len);
+}
+
+//-----------------------------------------------------------------------
+// Public stuff
+//-----------------------------------------------------------------------
+
+pp_bridge_t *pp_bridge_create(const pp_bridge_transport_t *transport, const pp_evloop_t *evloop, const char *proxy_prefix)
+{
+    if (transport == NULL || transport->read == NULL || transport->write == NULL || evloop == NULL)
+    {
+        ESP_LOGE(TAG, "%s: transport and event loop are required", __func__);
+        return NULL;
+    }
+    pp_bridge_t *b = pp_mem_new<pp_bridge_t>(PP_MEM_MODULES);
+    if (b == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate bridge", __func__);
+        return NULL;
+    }
+    b->transport = *transport;
+    b->evloop = *evloop;
+    b->prefix = proxy_prefix ? proxy_prefix : "";
+    b->tx_len = 0;
+    b->rx_len = 0;
+    return b;
+}
+
+void pp_bridge_delete(pp_bridge_t *b)
+{
+    if (b == NULL)
+        return;
+    for (auto it = b->exports.begin(); it != b->exports.end(); it++)
+    {
+        bridge_export_t *e = *it;
+        pp_unsubscribe(e->pp, &b->evloop, bridge_newstate_event);
+        pp_internal_set_bridge_export(e->pp, false);
+        bridge_export_list_t &list = exports_by_pp[e->pp];
+        list.remove(e);
+        if (list.empty())
+            exports_by_pp.erase(e->pp);
+        pp_mem_delete(PP_MEM_MODULES, e);
+    }
+    for (auto it = b->proxies.begin(); it != b->proxies.end(); it++)
+    {
+        proxies_by_pp.erase(it->second->pp);
+        pp_delete(it->second->pp);
+        pp_mem_delete(PP_MEM_MODULES, it->second);
+    }
+    pp_mem_delete(PP_MEM_MODULES, b);
+}
+
+bool pp_bridge_export(pp_bridge_t *b, pp_t pp)
+{
+    if (b == NULL || pp == NULL)
+        return false;
+    parameter_type_t type = (parameter_type_t)(pp_get_type(pp) & TYPE_ALL);
+    if (type != TYPE_INT32 && type != TYPE_INT64 && type != TYPE_FLOAT && type != TYPE_BOOL &&
+        type != TYPE_STRING && type != TYPE_FLOAT_ARRAY)
+    {
+        ESP_LOGE(TAG, "%s: %s has a type that can not be bridged", __func__, pp_get_name(pp));
+        return false;
+    }
+    if (b->exports.size() > UINT16_MAX)
+        return false;
+    // Peers get arrays, not the frames of an encoded array
+    if (!pp_internal_set_bridge_export(pp, true))
+    {
+        ESP_LOGE(TAG, "%s: %s has an array encoding, it can not be bridged", __func__, pp_get_name(pp));
+        return false;
+    }
+
+    bridge_export_t *e = pp_mem_new<bridge_export_t>(PP_MEM_MODULES);
+    if (e == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate export for %s", __func__, pp_get_name(pp));
+        pp_internal_set_bridge_export(pp, false);
+        return false;
+    }
+    e->bridge = b;
+    e->pp = pp;
+    e->id = b->exports.size();
+    e->type = type;
+    e->described = false;
+    e->dirty = false;
+    const void *valueptr = pp_get_valueptr(pp);
+    if (valueptr != NULL && bridge_encode_value(type, valueptr, &e->value))
+        e->dirty = true;
+    exports_by_pp[pp].push_back(e);
+    b->exports.push_back(e);
+    if (!pp_subscribe(pp, &b->evloop, bridge_newstate_event))
+    {
+        ESP_LOGE(TAG, "%s: Failed to subscribe to %s", __func__, pp_get_name(pp));
+        exports_by_pp[pp].remove(e);
+        b->exports.pop_back();
+        pp_mem_delete(PP_MEM_MODULES, e);
+        pp_internal_set_bridge_export(pp, false);
+        return false;
+    }
+    return true;
+}
+
+void pp_bridge_announce(pp_bridge_t *b)
+{
+    if (b == NULL)
+        return;
+    for (auto it = b->exports.begin(); it != b->exports.end(); it++)
+    {
+        (*it)->described = false;
+        (*it)->dirty = !(*it)->value.empty();
+    }
+}
+
+bool pp_bridge_poll(pp_bridge_t *b)
+{
+    if (b == NULL)
+        return false;
+    if (!bridge_flush(b))
+        return false;
+    // Only build new frames when the previous ones are sent, changes meanwhile overwrite each other
+    if (b->tx_len == 0)
+        bridge_send_changes(b);
+
+    while (b->rx_len < sizeof(b->rx))
+    {
+        int n = b->transport.read(b->transport.ctx, &b->rx[b->rx_len], sizeof(b->rx) - b->rx_len);
+        if (n < 0)
+            return false;
+        if (n == 0)
+            break;
+        b->rx_len += n;
+        bridge_receive(b);
+    }
+    return bridge_flush(b);
+}
+
+//-----------------------------------------------------------------------
+// File descriptor transport
+//-----------------------------------------------------------------------
+
+static int bridge_fd_write(void *ctx, const void *buf, size_t size)
+{
+    int n = write((int)(intptr_t)ctx, buf, size);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    return n;
+}
+
+static int bridge_fd_read(void *ctx, void *buf, size_t size)
+{
+    int n = read((int)(intptr_t)ctx, buf, size);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+    if (n == 0)
+        return -1; // end of stream
+    return n;
+}
+
+bool pp_bridge_fd_transport(pp_bridge_transport_t *transport, int fd)
+{
+    if (transport == NULL || fd < 0)
+        return false;
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+    {
+        ESP_LOGE(TAG, "%s: Failed to set fd %d non blocking", __func__, fd);
+        return false;
+    }
+    transport->ctx = (void *)(intptr_t)fd;
+    transport->write = bridge_fd_write;
+    transport->read = bridge_fd_read;
+    return true;
+}
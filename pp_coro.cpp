@@ -0,0 +1,192 @@
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "pp.h"
+#include "pp_coro.h"
+#include "pp_internal.h"
+
+namespace pp
+{
+    namespace detail
+    {
+        /// @brief One subscription on a receiver, shared by all coroutines waiting on the parameter there.
+        struct subscription
+        {
+            pp_t pp;
+            pp_evloop_t receiver;
+            size_t waiters;
+            subscription *next;
+        };
+
+        static subscription *subscriptions = nullptr;
+        static waiter *waiters = nullptr;
+        /// @brief Guards the lists, taken briefly from the receivers' tasks.
+        static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+        static const char *TAG = "PP_CORO";
+
+        /// @brief Held while a subscription is made or removed, so a receiver never has the handler
+        /// registered twice for a parameter, e.g. when a waiter is added while the last one resumes.
+        static SemaphoreHandle_t subscribe_lock()
+        {
+            static SemaphoreHandle_t handle = xSemaphoreCreateMutex();
+            return handle;
+        }
+
+        /// @brief Handler of all subscriptions, runs on the receiver and resumes the waiters there.
+        /// Receivers of a parameter have distinct bases, see add(), so the base tells them apart.
+        static void event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+        {
+            pp_t pp = (pp_t)arg;
+            // Take the waiters of this subscription out of the list, the checks copy the value and may
+            // run a predicate of the user, so they run outside the lock
+            waiter *candidates = nullptr;
+            portENTER_CRITICAL(&lock);
+            for (waiter **w = &waiters; *w != nullptr;)
+            {
+                waiter *current = *w;
+                if (current->sub->pp != pp || current->sub->receiver.base != event_base)
+                {
+                    w = &current->next;
+                    continue;
+                }
+                *w = current->next;
+                current->next = candidates;
+                candidates = current;
+            }
+            portEXIT_CRITICAL(&lock);
+
+            waiter *ready = nullptr;
+            waiter *waiting = nullptr;
+            size_t ready_count = 0;
+            subscription *sub = nullptr;
+            while (candidates != nullptr)
+            {
+                waiter *current = candidates;
+                candidates = current->next;
+                sub = current->sub;
+                if (current->check(current, event_data))
+                {
+                    current->next = ready;
+                    ready = current;
+                    ready_count++;
+                }
+                else
+                {
+                    current->next = waiting;
+                    waiting = current;
+                }
+            }
+
+            portENTER_CRITICAL(&lock);
+            while (waiting != nullptr)
+            {
+                waiter *current = waiting;
+                waiting = current->next;
+                current->next = waiters;
+                waiters = current;
+            }
+            // The candidates share one subscription, add() keeps one per parameter and base
+            if (sub != nullptr)
+                sub->waiters -= ready_count;
+            portEXIT_CRITICAL(&lock);
+
+            // Resumed coroutines may wait again, on this subscription or another one
+            while (ready != nullptr)
+            {
+                waiter *current = ready;
+                ready = current->next;
+                current->resume(current);
+            }
+
+            xSemaphoreTake(subscribe_lock(), portMAX_DELAY);
+            subscription *unused = nullptr;
+            portENTER_CRITICAL(&lock);
+            for (subscription **s = &subscriptions; *s != nullptr; s = &(*s)->next)
+            {
+                if ((*s)->pp == pp && (*s)->receiver.base == event_base && (*s)->waiters == 0)
+                {
+                    unused = *s;
+                    *s = unused->next;
+                    break;
+                }
+            }
+            portEXIT_CRITICAL(&lock);
+            if (unused != nullptr)
+            {
+                pp_unsubscribe(unused->pp, &unused->receiver, event);
+                pp_mem_delete(PP_MEM_MODULES, unused);
+            }
+            xSemaphoreGive(subscribe_lock());
+        }
+
+        bool type_matches(pp_t pp, parameter_type_t type)
+        {
+            if ((pp_get_type(pp) & TYPE_ALL) == type)
+                return true;
+            ESP_LOGE(TAG, "%s: %s has type 0x%x, awaited as 0x%x", __func__, pp ? pp_get_name(pp) : "NULL", pp_get_type(pp) & TYPE_ALL, type);
+            return false;
+        }
+
+        bool add(waiter *w, pp_t pp, const pp_evloop_t *receiver, parameter_type_t type)
+        {
+            if (!type_matches(pp, type))
+                return false;
+
+            xSemaphoreTake(subscribe_lock(), portMAX_DELAY);
+            subscription *sub = nullptr;
+            bool conflict = false;
+            portENTER_CRITICAL(&lock);
+            for (subscription *s = subscriptions; s != nullptr; s = s->next)
+            {
+                if (s->pp != pp || s->receiver.base != receiver->base)
+                    continue;
+                if (s->receiver.loop_handle == receiver->loop_handle)
+                    sub = s;
+                else
+                    conflict = true;
+            }
+            if (sub != nullptr)
+            {
+                sub->waiters++;
+                w->sub = sub;
+                w->next = waiters;
+                waiters = w;
+            }
+            portEXIT_CRITICAL(&lock);
+            if (sub != nullptr || conflict)
+            {
+                xSemaphoreGive(subscribe_lock());
+                if (conflict)
+                    ESP_LOGE(TAG, "%s: %s is awaited on another loop with base %s", __func__, pp_get_name(pp), receiver->base);
+                return !conflict;
+            }
+
+            sub = pp_mem_new<subscription>(PP_MEM_MODULES);
+            if (sub == nullptr)
+            {
+                xSemaphoreGive(subscribe_lock());
+                ESP_LOGE(TAG, "%s: Failed to allocate the subscription to %s", __func__, pp_get_name(pp));
+                return false;
+            }
+            sub->pp = pp;
+            sub->receiver = *receiver;
+            sub->waiters = 1;
+            if (!pp_subscribe(pp, receiver, event))
+            {
+                pp_mem_delete(PP_MEM_MODULES, sub);
+                xSemaphoreGive(subscribe_lock());
+                return false;
+            }
+            w->sub = sub;
+            portENTER_CRITICAL(&lock);
+            sub->next = subscriptions;
+            subscriptions = sub;
+            w->next = waiters;
+            waiters = w;
+            portEXIT_CRITICAL(&lock);
+            xSemaphoreGive(subscribe_lock());
+            return true;
+        }
+    } // namespace detail
+} // namespace pp
@@ -0,0 +1,200 @@
+#include <string.h>
+#include <stddef.h>
+#include <map>
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "pp.h"
+#include "pp_group.h"
+#include "pp_internal.h"
+
+typedef struct
+{
+    pp_t members[PP_GROUP_MAX_MEMBERS];
+    /// @brief Odd while a commit writes the snapshot, readers retry until it is even and unchanged.
+    uint32_t sequence;
+    pp_group_snapshot_t snapshot;
+    portMUX_TYPE lock;
+    /// @brief Calls using the group, guarded by groups_lock. A deleted group is freed by the last one.
+    uint32_t users;
+    bool deleted;
+} group_t;
+
+typedef std::map<pp_t, group_t *, std::less<pp_t>, pp_allocator<std::pair<const pp_t, group_t *>, PP_MEM_MODULES>> group_map_t;
+
+// Nodes are allocated and freed outside groups_lock, only linked and unlinked inside it
+static group_map_t groups;
+static portMUX_TYPE groups_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *TAG = "PP_GROUP";
+
+/// @brief Find a group and hold it until group_release(), also if it is deleted meanwhile.
+static group_t *group_acquire(pp_t group)
+{
+    group_t *g = NULL;
+    portENTER_CRITICAL(&groups_lock);
+    auto it = groups.find(group);
+    if (it != groups.end())
+    {
+        g = it->second;
+        g->users++;
+    }
+    portEXIT_CRITICAL(&groups_lock);
+    return g;
+}
+
+static void group_release(group_t *g)
+{
+    portENTER_CRITICAL(&groups_lock);
+    bool last = --g->users == 0 && g->deleted;
+    portEXIT_CRITICAL(&groups_lock);
+    if (last)
+        pp_mem_delete(PP_MEM_MODULES, g);
+}
+
+static bool group_read_member(pp_t pp, pp_value_t *value)
+{
+    const void *valueptr = pp_get_valueptr(pp);
+    memset(value, 0, sizeof(*value));
+    if (valueptr == NULL)
+        return false;
+    switch (pp_get_type(pp) & TYPE_ALL)
+    {
+    case TYPE_INT32:
+        value->i32 = *(const int32_t *)valueptr;
+        return true;
+    case TYPE_INT64:
+        value->i64 = *(const int64_t *)valueptr;
+        return true;
+    case TYPE_FLOAT:
+        value->f = *(const float *)valueptr;
+        return true;
+    case TYPE_BOOL:
+        value->b = *(const bool *)valueptr;
+        return true;
+    default:
+        return false;
+    }
+}
+
+pp_t pp_group_create(const char *name, const pp_evloop_t *owner, const pp_t *members, size_t count)
+{
+    if (members == NULL || count == 0 || count > PP_GROUP_MAX_MEMBERS)
+    {
+        ESP_LOGE(TAG, "%s: %s needs 1 to %d members", __func__, name, PP_GROUP_MAX_MEMBERS);
+        return NULL;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        switch (pp_get_type(members[i]) & TYPE_ALL)
+        {
+        case TYPE_INT32:
+        case TYPE_INT64:
+        case TYPE_FLOAT:
+        case TYPE_BOOL:
+            break;
+        default:
+            ESP_LOGE(TAG, "%s: Member %d of %s is not a scalar parameter", __func__, i, name);
+            return NULL;
+        }
+    }
+
+    group_t *g = pp_mem_new<group_t>(PP_MEM_MODULES);
+    if (g == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate %s", __func__, name);
+        return NULL;
+    }
+    pp_t pp = pp_create_binary(name, owner, NULL);
+    if (pp == NULL)
+    {
+        pp_mem_delete(PP_MEM_MODULES, g);
+        return NULL;
+    }
+    memcpy(g->members, members, count * sizeof(pp_t));
+    g->snapshot.count = count;
+    g->lock = portMUX_INITIALIZER_UNLOCKED;
+    for (size_t i = 0; i < count; i++)
+        group_read_member(members[i], &g->snapshot.values[i]);
+
+    group_map_t node_map;
+    node_map[pp] = g;
+    group_map_t::node_type node = node_map.extract(pp);
+    portENTER_CRITICAL(&groups_lock);
+    bool inserted = groups.insert(std::move(node)).inserted;
+    portEXIT_CRITICAL(&groups_lock);
+    if (!inserted)
+    {
+        ESP_LOGE(TAG, "%s: %s is already a group", __func__, name);
+        pp_mem_delete(PP_MEM_MODULES, g);
+        return NULL;
+    }
+    pp_set_valueptr(pp, &g->snapshot);
+    return pp;
+}
+
+bool pp_group_delete(pp_t group)
+{
+    // Unlinked under the lock, calls still using the group free it when they are done
+    portENTER_CRITICAL(&groups_lock);
+    group_map_t::node_type node = groups.extract(group);
+    group_t *g = node.empty() ? NULL : node.mapped();
+    if (g != NULL)
+    {
+        g->users++;
+        g->deleted = true;
+    }
+    portEXIT_CRITICAL(&groups_lock);
+    if (g == NULL)
+        return false;
+    pp_delete(group);
+    group_release(g);
+    return true;
+}
+
+bool pp_group_commit(pp_t group)
+{
+    group_t *g = group_acquire(group);
+    if (g == NULL)
+        return false;
+
+    // Read the members outside the critical section, derived members are computed when read
+    pp_group_snapshot_t next;
+    next.count = g->snapshot.count;
+    for (size_t i = 0; i < next.count; i++)
+        group_read_member(g->members[i], &next.values[i]);
+
+    size_t size = offsetof(pp_group_snapshot_t, values) + next.count * sizeof(pp_value_t);
+    portENTER_CRITICAL_SAFE(&g->lock);
+    next.version = g->snapshot.version + 1;
+    __atomic_store_n(&g->sequence, g->sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&g->snapshot, &next, size);
+    __atomic_store_n(&g->sequence, g->sequence + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL_SAFE(&g->lock);
+
+    for (size_t i = 0; i < next.count; i++)
+        pp_internal_changed(g->members[i]);
+    group_release(g);
+    return pp_post_newstate_binary(group, &next, size);
+}
+
+bool pp_group_snapshot(pp_t group, pp_group_snapshot_t *snapshot)
+{
+    if (snapshot == NULL)
+        return false;
+    group_t *g = group_acquire(group);
+    if (g == NULL)
+        return false;
+
+    uint32_t sequence;
+    do
+    {
+        sequence = __atomic_load_n(&g->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1)
+            continue;
+        memcpy(snapshot, &g->snapshot, sizeof(pp_group_snapshot_t));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((sequence & 1) || __atomic_load_n(&g->sequence, __ATOMIC_RELAXED) != sequence);
+    group_release(g);
+    return true;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+// Interface between pp.cpp and the optional modules, not part of the public API.
+
+#include <string>
+#include <string.h>
+#include <stdlib.h>
+#include <new>
+#include "pp.h"
+#include "pp_array.h"
+
+/// @brief Mark a parameter as persistent so new states are reported to pp_persist_mark_dirty().
+/// @param pp The parameter handle.
+/// @param persistent True to report new states, false to stop.
+void pp_internal_set_persistent(pp_t pp, bool persistent);
+
+/// @brief Handle a value change made without a new state post, e.g. by a group commit.
+/// Invalidates render caches and derived parameters and reports persistent parameters.
+/// @param pp The parameter handle.
+void pp_internal_changed(pp_t pp);
+
+/// @brief Encoder state of a float array parameter, see pp_array.h.
+struct pp_array_encoder_t;
+
+/// @brief Set the array encoder of a parameter, the library frees it with pp_array_encoder_free().
+/// Refused while a bridge exports the parameter, its peers would get frames instead of arrays.
+/// @param encoder The encoder, NULL for raw arrays.
+/// @param old Set to the previous encoder, to be freed by the caller. Unchanged if refused.
+/// @return True if the encoder was set.
+bool pp_internal_set_array_encoder(pp_t pp, pp_array_encoder_t *encoder, pp_array_encoder_t **old);
+
+/// @brief Get the encoding of a parameter's encoder, copied while the encoder can not be replaced.
+/// @return False for raw arrays and unknown parameters.
+bool pp_internal_get_array_encoding(pp_t pp, pp_array_encoding_t *encoding);
+
+/// @brief Count a bridge export of a parameter, see pp_bridge_export().
+/// @param exported True when exported, false when the export is removed.
+/// @return False if an export is refused because the parameter is encoded.
+bool pp_internal_set_bridge_export(pp_t pp, bool exported);
+
+/// @brief Copy the encoding an encoder was made with.
+/// @return True, encoders are never PP_ARRAY_RAW.
+bool pp_array_encoder_config(const pp_array_encoder_t *encoder, pp_array_encoding_t *encoding);
+
+/// @brief Encode an array into a frame allocated with pp_mem_alloc_sized(PP_MEM_EVENTS, *size).
+/// @param subscribers The number of subscribers, a new subscriber gets a keyframe.
+/// @return The frame, or NULL on failure.
+void *pp_array_encode(pp_array_encoder_t *encoder, const pp_float_array_t *array, size_t subscribers, size_t *size);
+
+/// @brief Free an encoder.
+void pp_array_encoder_free(pp_array_encoder_t *encoder);
+
+/// @brief Set while the trace recorder is running, checked before a post is timed and recorded.
+extern volatile bool pp_trace_active;
+
+/// @brief Record a post in the trace ring, see pp_trace.h. Safe to call from an ISR.
+/// @param kind One of pp_trace_kind_t.
+/// @param index The parameter index, or -1 for none.
+/// @param receiver The event loop posted to.
+/// @param size The payload size.
+/// @param ok True if the post succeeded.
+/// @param start_us esp_timer_get_time() before the post.
+void pp_trace_record(uint8_t kind, int index, const pp_evloop_t *receiver, size_t size, bool ok, int64_t start_us);
+
+/// @brief Set while the recorder is running, checked before a new state is recorded.
+extern volatile bool pp_record_active;
+
+/// @brief Append a new state to the recording, see pp_record.h. Safe to call from an ISR.
+/// @param index The parameter index.
+/// @param value The new state as passed to pp_post_newstate_*, the floats for float arrays.
+/// @param size The size of the new state.
+void pp_record_post(int index, const void *value, size_t size);
+
+/// @brief Allocate memory through the hooks and account it to a category. Free with pp_mem_free_sized().
+void *pp_mem_alloc_sized(pp_mem_category_t category, size_t size);
+
+/// @brief Free memory allocated with pp_mem_alloc_sized(), with the same category and size.
+void pp_mem_free_sized(pp_mem_category_t category, void *ptr, size_t size);
+
+/// @brief Allocate memory that remembers its size and category, free it with pp_free().
+void *pp_mem_alloc(pp_mem_category_t category, size_t size);
+
+/// @brief Allocate an object with pp_mem_alloc_sized() and value initialize it.
+template <typename T>
+T *pp_mem_new(pp_mem_category_t category)
+{
+    void *ptr = pp_mem_alloc_sized(category, sizeof(T));
+    if (ptr == NULL)
+        return NULL;
+    return new (ptr) T();
+}
+
+/// @brief Destroy an object allocated with pp_mem_new().
+template <typename T>
+void pp_mem_delete(pp_mem_category_t category, T *ptr)
+{
+    if (ptr == NULL)
+        return;
+    ptr->~T();
+    pp_mem_free_sized(category, ptr, sizeof(T));
+}
+
+/// @brief Allocator for the library's containers, routes their nodes through the hooks.
+template <typename T, pp_mem_category_t C>
+struct pp_allocator
+{
+    typedef T value_type;
+    template <typename U>
+    struct rebind
+    {
+        typedef pp_allocator<U, C> other;
+    };
+
+    pp_allocator() noexcept {}
+    template <typename U>
+    pp_allocator(const pp_allocator<U, C> &) noexcept {}
+
+    T *allocate(size_t n)
+    {
+        T *ptr = (T *)pp_mem_alloc_sized(C, n * sizeof(T));
+        if (ptr == NULL)
+        {
+#if __cpp_exceptions
+            throw std::bad_alloc();
+#else
+            abort();
+#endif
+        }
+        return ptr;
+    }
+    void deallocate(T *ptr, size_t n) noexcept { pp_mem_free_sized(C, ptr, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const pp_allocator<U, C> &) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const pp_allocator<U, C> &) const noexcept { return false; }
+};
+
+template <pp_mem_category_t C>
+using pp_string = std::basic_string<char, std::char_traits<char>, pp_allocator<char, C>>;
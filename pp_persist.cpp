@@ -0,0 +1,479 @@
+#include <string>
+#include <string.h>
+#include <stdio.h>
+#include <map>
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_event.h"
+#include "nvs.h"
+#include "pp.h"
+#include "pp_persist.h"
+#include "pp_internal.h"
+
+#define PERSIST_MAGIC 0x31535050 // "PPS1"
+#define PERSIST_VERSION 1
+
+typedef struct __attribute__((packed))
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t size;     ///< Size of the entries following the header.
+    uint32_t checksum; ///< FNV-1a of the entries.
+} persist_header_t;
+
+// Each entry is: uint8_t name length, name, uint16_t type, uint16_t value size, value.
+typedef struct __attribute__((packed))
+{
+    uint16_t type;
+    uint16_t size;
+} persist_entry_tail_t;
+
+typedef struct
+{
+    size_t size;
+} persist_entry_t;
+
+static pp_persist_backend_t backend;
+static bool initialized = false;
+static uint32_t delay_ms = PP_PERSIST_DEFAULT_DELAY_MS;
+static esp_timer_handle_t flush_timer = NULL;
+/// @brief Runs the delayed flushes, a store can take long and must not block the esp_timer task.
+static esp_event_loop_handle_t flush_loop = NULL;
+static const char *FLUSH_BASE = "pp_persist";
+/// @brief Guards attached, stored and dirty, and the flush timer. Held only briefly, not during a store.
+static SemaphoreHandle_t lock = NULL;
+/// @brief Held by a flush from building the record until the stored record is replaced, so flushes
+/// on the timer task and from detach write in order.
+static SemaphoreHandle_t flush_lock = NULL;
+static bool dirty = false;
+static std::map<pp_t, persist_entry_t, std::less<pp_t>, pp_allocator<std::pair<const pp_t, persist_entry_t>, PP_MEM_MODULES>> attached;
+/// @brief The record read at boot, entries of parameters not attached are written back unchanged.
+static uint8_t *stored = NULL;
+static size_t stored_size = 0;
+static uint16_t stored_count = 0;
+
+static const char *TAG = "PP_PERSIST";
+
+static uint32_t persist_checksum(const uint8_t *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/// @brief Iterate the entries of the stored record. Call with lock held.
+/// @return The offset of the next entry, or 0 when there are no more entries.
+static size_t persist_next_entry(size_t offset, const char **name, size_t *name_len, const persist_entry_tail_t **tail, const uint8_t **value)
+{
+    if (offset + 1 > stored_size)
+        return 0;
+    size_t len = stored[offset];
+    if (offset + 1 + len + sizeof(persist_entry_tail_t) > stored_size)
+        return 0;
+    const persist_entry_tail_t *t = (const persist_entry_tail_t *)&stored[offset + 1 + len];
+    size_t next = offset + 1 + len + sizeof(persist_entry_tail_t) + t->size;
+    if (next > stored_size)
+        return 0;
+    *name = (const char *)&stored[offset + 1];
+    *name_len = len;
+    *tail = t;
+    *value = &stored[offset + 1 + len + sizeof(persist_entry_tail_t)];
+    return next;
+}
+
+static size_t persist_type_size(parameter_type_t type)
+{
+    switch (type & TYPE_ALL)
+    {
+    case TYPE_INT32:
+        return sizeof(int32_t);
+    case TYPE_INT64:
+        return sizeof(int64_t);
+    case TYPE_FLOAT:
+        return sizeof(float);
+    case TYPE_BOOL:
+        return sizeof(bool);
+    default:
+        return 0;
+    }
+}
+
+static void persist_flush_event(void *handler_arg, esp_event_base_t base, int32_t id, void *event_data)
+{
+    pp_persist_flush();
+}
+
+static void persist_timer_cb(void *arg)
+{
+    // Only signal the flush task. A flush already queued writes this change too.
+    esp_event_post_to(flush_loop, FLUSH_BASE, 0, NULL, 0, 0);
+}
+
+/// @brief Set dirty and start the flush timer if it is not running. Call with lock held.
+static void persist_set_dirty(void)
+{
+    dirty = true;
+    if (flush_timer == NULL || esp_timer_is_active(flush_timer))
+        return;
+    esp_timer_start_once(flush_timer, (uint64_t)delay_ms * 1000);
+}
+
+/// @brief Call with lock held.
+static bool persist_is_attached(const char *name, size_t len)
+{
+    for (auto it = attached.begin(); it != attached.end(); it++)
+    {
+        const char *attached_name = pp_get_name(it->first);
+        if (strlen(attached_name) == len && memcmp(attached_name, name, len) == 0)
+            return true;
+    }
+    return false;
+}
+
+bool pp_persist_init(const pp_persist_backend_t *b, uint32_t delay)
+{
+    if (b == NULL || b->load == NULL || b->store == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Backend is incomplete", __func__);
+        return false;
+    }
+    if (initialized)
+    {
+        ESP_LOGW(TAG, "%s: Already initialized", __func__);
+        return false;
+    }
+    lock = xSemaphoreCreateMutex();
+    flush_lock = xSemaphoreCreateMutex();
+    if (lock == NULL || flush_lock == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to create mutex", __func__);
+        return false;
+    }
+    backend = *b;
+    delay_ms = delay;
+
+    esp_event_loop_args_t loop_args = {};
+    loop_args.queue_size = 1;
+    loop_args.task_name = "pp_persist";
+    loop_args.task_priority = PP_PERSIST_TASK_PRIORITY;
+    loop_args.task_stack_size = PP_PERSIST_TASK_STACK_SIZE;
+    loop_args.task_core_id = tskNO_AFFINITY;
+    if (esp_event_loop_create(&loop_args, &flush_loop) != ESP_OK ||
+        esp_event_handler_register_with(flush_loop, FLUSH_BASE, 0, persist_flush_event, NULL) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: Failed to create flush task", __func__);
+        return false;
+    }
+
+    esp_timer_create_args_t args = {};
+    args.callback = persist_timer_cb;
+    args.name = "pp_persist";
+    if (esp_timer_create(&args, &flush_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: Failed to create timer", __func__);
+        return false;
+    }
+    initialized = true;
+
+    size_t size = 0;
+    if (!backend.load(backend.ctx, NULL, &size) || size < sizeof(persist_header_t))
+    {
+        ESP_LOGI(TAG, "%s: No stored parameters", __func__);
+        return true;
+    }
+    uint8_t *buf = (uint8_t *)pp_mem_alloc(PP_MEM_MODULES, size);
+    if (buf == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate %d bytes", __func__, size);
+        return true;
+    }
+    persist_header_t header;
+    if (!backend.load(backend.ctx, buf, &size) || size < sizeof(header))
+    {
+        ESP_LOGE(TAG, "%s: Failed to read stored parameters", __func__);
+        pp_free(buf);
+        return true;
+    }
+    memcpy(&header, buf, sizeof(header));
+    if (header.magic != PERSIST_MAGIC || header.version != PERSIST_VERSION || header.size != size - sizeof(header) ||
+        header.checksum != persist_checksum(buf + sizeof(header), header.size))
+    {
+        ESP_LOGE(TAG, "%s: Stored parameters are invalid, ignored", __func__);
+        pp_free(buf);
+        return true;
+    }
+    memmove(buf, buf + sizeof(header), header.size);
+    stored = buf;
+    stored_size = header.size;
+    stored_count = header.count;
+    ESP_LOGI(TAG, "%s: Read %d stored parameters", __func__, stored_count);
+    return true;
+}
+
+bool pp_persist_attach(pp_t pp, size_t size)
+{
+    if (pp == NULL)
+    {
+        ESP_LOGW(TAG, "%s: parameter is NULL", __func__);
+        return false;
+    }
+    if (!initialized)
+    {
+        ESP_LOGE(TAG, "%s: %s attached before pp_persist_init", __func__, pp_get_name(pp));
+        return false;
+    }
+    void *valueptr = (void *)pp_get_valueptr(pp);
+    if (size == 0)
+        size = persist_type_size(pp_get_type(pp));
+    if (valueptr == NULL || size == 0 || size > UINT16_MAX)
+    {
+        ESP_LOGE(TAG, "%s: %s needs a value pointer and a size", __func__, pp_get_name(pp));
+        return false;
+    }
+
+    const char *name = pp_get_name(pp);
+    size_t len = strlen(name);
+    const char *sname;
+    size_t slen;
+    const persist_entry_tail_t *tail;
+    const uint8_t *value;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    for (size_t offset = 0; (offset = persist_next_entry(offset, &sname, &slen, &tail, &value)) != 0;)
+    {
+        if (slen != len || memcmp(sname, name, len) != 0)
+            continue;
+        if (tail->type != (pp_get_type(pp) & TYPE_ALL) || tail->size > size)
+        {
+            ESP_LOGW(TAG, "%s: %s stored with another type or size, not restored", __func__, name);
+            break;
+        }
+        memcpy(valueptr, value, tail->size);
+        break;
+    }
+
+    attached[pp].size = size;
+    xSemaphoreGive(lock);
+    pp_internal_set_persistent(pp, true);
+    return true;
+}
+
+bool pp_persist_detach(pp_t pp)
+{
+    if (!initialized)
+        return false;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    bool found = attached.count(pp) != 0;
+    // Keep the current value in the stored record
+    dirty = dirty || found;
+    xSemaphoreGive(lock);
+    if (!found)
+        return false;
+    pp_persist_flush();
+    pp_internal_set_persistent(pp, false);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    attached.erase(pp);
+    xSemaphoreGive(lock);
+    return true;
+}
+
+void pp_persist_mark_dirty(pp_t pp)
+{
+    if (!initialized)
+        return;
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (attached.find(pp) != attached.end())
+        persist_set_dirty();
+    xSemaphoreGive(lock);
+}
+
+bool pp_persist_flush(void)
+{
+    if (!initialized)
+        return false;
+
+    xSemaphoreTake(flush_lock, portMAX_DELAY);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!dirty)
+    {
+        xSemaphoreGive(lock);
+        xSemaphoreGive(flush_lock);
+        return true;
+    }
+    dirty = false;
+
+    // Size the record, attached parameters first then stored entries that are not attached
+    size_t size = sizeof(persist_header_t);
+    for (auto it = attached.begin(); it != attached.end(); it++)
+        size += 1 + strlen(pp_get_name(it->first)) + sizeof(persist_entry_tail_t) + it->second.size;
+    size += stored_size;
+
+    uint8_t *buf = (uint8_t *)pp_mem_alloc(PP_MEM_MODULES, size);
+    if (buf == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate %d bytes", __func__, size);
+        persist_set_dirty();
+        xSemaphoreGive(lock);
+        xSemaphoreGive(flush_lock);
+        return false;
+    }
+
+    persist_header_t header = {};
+    size_t len = sizeof(header);
+    for (auto it = attached.begin(); it != attached.end(); it++)
+    {
+        const char *name = pp_get_name(it->first);
+        size_t name_len = strlen(name);
+        if (name_len > UINT8_MAX)
+            continue;
+        persist_entry_tail_t tail = {(uint16_t)(pp_get_type(it->first) & TYPE_ALL), (uint16_t)it->second.size};
+        buf[len++] = (uint8_t)name_len;
+        memcpy(&buf[len], name, name_len);
+        len += name_len;
+        memcpy(&buf[len], &tail, sizeof(tail));
+        len += sizeof(tail);
+        memcpy(&buf[len], pp_get_valueptr(it->first), it->second.size);
+        len += it->second.size;
+        header.count++;
+    }
+    const char *sname;
+    size_t slen;
+    const persist_entry_tail_t *tail;
+    const uint8_t *value;
+    for (size_t offset = 0, next; (next = persist_next_entry(offset, &sname, &slen, &tail, &value)) != 0; offset = next)
+    {
+        if (persist_is_attached(sname, slen))
+            continue;
+        memcpy(&buf[len], &stored[offset], next - offset);
+        len += next - offset;
+        header.count++;
+    }
+
+    header.magic = PERSIST_MAGIC;
+    header.version = PERSIST_VERSION;
+    header.size = len - sizeof(header);
+    header.checksum = persist_checksum(buf + sizeof(header), header.size);
+    memcpy(buf, &header, sizeof(header));
+    // Changes while storing mark dirty again and are written by the next flush
+    xSemaphoreGive(lock);
+
+    bool ok = backend.store(backend.ctx, buf, len);
+    if (!ok)
+        ESP_LOGE(TAG, "%s: Failed to store %d parameters", __func__, header.count);
+    xSemaphoreTake(lock, portMAX_DELAY);
+    if (!ok)
+    {
+        pp_free(buf);
+        persist_set_dirty();
+    }
+    else
+    {
+        // The written record replaces the one read at boot, it keeps values of detached parameters
+        memmove(buf, buf + sizeof(header), header.size);
+        pp_free(stored);
+        stored = buf;
+        stored_size = header.size;
+        stored_count = header.count;
+    }
+    xSemaphoreGive(lock);
+    xSemaphoreGive(flush_lock);
+    return ok;
+}
+
+//-----------------------------------------------------------------------
+// Backends
+//-----------------------------------------------------------------------
+
+static bool persist_nvs_load(void *ctx, void *buf, size_t *size)
+{
+    nvs_handle_t handle;
+    if (nvs_open(PP_PERSIST_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+        return false;
+    esp_err_t err = nvs_get_blob(handle, (const char *)ctx, buf, size);
+    nvs_close(handle);
+    return err == ESP_OK;
+}
+
+static bool persist_nvs_store(void *ctx, const void *buf, size_t size)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(PP_PERSIST_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: Failed opening %s - %s", __func__, PP_PERSIST_NVS_NAMESPACE, esp_err_to_name(err));
+        return false;
+    }
+    err = nvs_set_blob(handle, (const char *)ctx, buf, size);
+    if (err == ESP_OK)
+        err = nvs_commit(handle);
+    nvs_close(handle);
+    return err == ESP_OK;
+}
+
+static bool persist_file_load(void *ctx, void *buf, size_t *size)
+{
+    FILE *f = fopen((const char *)ctx, "rb");
+    if (f == NULL)
+        return false;
+    bool ok;
+    if (buf == NULL)
+    {
+        ok = fseek(f, 0, SEEK_END) == 0;
+        long len = ftell(f);
+        ok = ok && len >= 0;
+        *size = ok ? (size_t)len : 0;
+    }
+    else
+    {
+        *size = fread(buf, 1, *size, f);
+        ok = ferror(f) == 0;
+    }
+    fclose(f);
+    return ok;
+}
+
+static bool persist_file_store(void *ctx, const void *buf, size_t size)
+{
+    pp_string<PP_MEM_MODULES> tmp = (const char *)ctx;
+    tmp += ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (f == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed opening %s", __func__, tmp.c_str());
+        return false;
+    }
+    bool ok = fwrite(buf, 1, size, f) == size;
+    ok = (fclose(f) == 0) && ok;
+    if (ok)
+        ok = rename(tmp.c_str(), (const char *)ctx) == 0;
+    if (!ok)
+        remove(tmp.c_str());
+    return ok;
+}
+
+bool pp_persist_nvs_backend(pp_persist_backend_t *b, const char *key)
+{
+    if (b == NULL || key == NULL)
+        return false;
+    b->ctx = (void *)key;
+    b->load = persist_nvs_load;
+    b->store = persist_nvs_store;
+    return true;
+}
+
+bool pp_persist_file_backend(pp_persist_backend_t *b, const char *path)
+{
+    if (b == NULL || path == NULL)
+        return false;
+    b->ctx = (void *)path;
+    b->load = persist_file_load;
+    b->store = persist_file_store;
+    return true;
+}
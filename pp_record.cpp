@@ -0,0 +1,359 @@
+#include <string.h>
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "pp.h"
+#include "pp_record.h"
+#include "pp_internal.h"
+
+#define RECORD_VERSION 1
+#define RECORD_ALIGN(size) (((size) + 3) & ~(size_t)3)
+
+/// @brief Recorded new state, followed by the value padded to 4 bytes.
+/// The time is 64 bits as two halves, so entries only need 4 byte alignment.
+typedef struct
+{
+    uint32_t time_us_low;
+    uint32_t time_us_high;
+    uint16_t index;
+    uint16_t reserved;
+    uint32_t size;
+} record_entry_t;
+
+volatile bool pp_record_active = false;
+
+static uint8_t *buffer = NULL;
+static size_t buffer_size = 0;
+static size_t buffer_used = 0;
+static uint32_t entry_count = 0;
+static uint32_t dropped = 0;
+static int64_t start_us = 0;
+/// @brief Posts copying into the entry they reserved, the buffer is not read or replaced until they are done.
+static uint32_t writers = 0;
+static portMUX_TYPE record_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *TAG = "PP_RECORD";
+
+void pp_record_post(int index, const void *value, size_t size)
+{
+    int64_t now = esp_timer_get_time();
+    size_t needed = sizeof(record_entry_t) + RECORD_ALIGN(size);
+    record_entry_t *e = NULL;
+    uint64_t time_us = 0;
+    // Only reserve the entry under the lock, values can be large
+    portENTER_CRITICAL_SAFE(&record_lock);
+    if (pp_record_active)
+    {
+        if (buffer_used + needed > buffer_size)
+            dropped++;
+        else
+        {
+            e = (record_entry_t *)(buffer + buffer_used);
+            time_us = now - start_us;
+            buffer_used += needed;
+            entry_count++;
+            writers++;
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&record_lock);
+    if (e == NULL)
+        return;
+
+    e->time_us_low = (uint32_t)time_us;
+    e->time_us_high = (uint32_t)(time_us >> 32);
+    e->index = index;
+    e->reserved = 0;
+    e->size = size;
+    memcpy(e + 1, value, size);
+    portENTER_CRITICAL_SAFE(&record_lock);
+    writers--;
+    portEXIT_CRITICAL_SAFE(&record_lock);
+}
+
+/// @brief Wait until the posts that reserved an entry have copied their values.
+static void record_wait_writers(void)
+{
+    for (;;)
+    {
+        portENTER_CRITICAL(&record_lock);
+        uint32_t n = writers;
+        portEXIT_CRITICAL(&record_lock);
+        if (n == 0)
+            return;
+        vTaskDelay(1);
+    }
+}
+
+bool pp_record_start(size_t size)
+{
+    if (size == 0)
+        return false;
+    pp_record_stop();
+    record_wait_writers();
+    uint8_t *buf = (uint8_t *)pp_mem_alloc(PP_MEM_MODULES, size);
+    if (buf == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate %d bytes", __func__, size);
+        return false;
+    }
+    uint8_t *old;
+    portENTER_CRITICAL(&record_lock);
+    old = buffer;
+    buffer = buf;
+    buffer_size = size;
+    buffer_used = 0;
+    entry_count = 0;
+    dropped = 0;
+    start_us = esp_timer_get_time();
+    pp_record_active = true;
+    portEXIT_CRITICAL(&record_lock);
+    pp_free(old);
+    return true;
+}
+
+void pp_record_stop(void)
+{
+    portENTER_CRITICAL(&record_lock);
+    pp_record_active = false;
+    portEXIT_CRITICAL(&record_lock);
+}
+
+bool pp_record_dump(void *buf, size_t *size)
+{
+    if (size == NULL || buffer == NULL)
+        return false;
+
+    portENTER_CRITICAL(&record_lock);
+    bool was_active = pp_record_active;
+    pp_record_active = false;
+    portEXIT_CRITICAL(&record_lock);
+    record_wait_writers();
+
+    // Only parameters that appear in the recording are named
+    size_t par_count = 0;
+    while (pp_get_par(par_count) != NULL)
+        par_count++;
+    size_t used_size = (par_count + 7) / 8 + 1;
+    uint8_t *used = (uint8_t *)pp_mem_alloc(PP_MEM_MODULES, used_size);
+    if (used != NULL)
+        memset(used, 0, used_size);
+    size_t names = 0;
+    uint32_t param_count = 0;
+    for (size_t offset = 0; offset < buffer_used && used != NULL;)
+    {
+        const record_entry_t *e = (const record_entry_t *)(buffer + offset);
+        offset += sizeof(record_entry_t) + RECORD_ALIGN(e->size);
+        if (e->index >= par_count || (used[e->index / 8] & (1 << (e->index % 8))))
+            continue;
+        const char *name = pp_get_name(pp_get_par(e->index));
+        if (name == NULL)
+            continue;
+        used[e->index / 8] |= 1 << (e->index % 8);
+        names += 5 + strnlen(name, 0xFF);
+        param_count++;
+    }
+    size_t needed = 6 * sizeof(uint32_t) + RECORD_ALIGN(names) + buffer_used;
+
+    bool ok = false;
+    if (buf != NULL && *size >= needed)
+    {
+        uint8_t *out = (uint8_t *)buf;
+        uint32_t header[6] = {PP_RECORD_MAGIC, RECORD_VERSION, entry_count, param_count, dropped, (uint32_t)buffer_used};
+        memcpy(out, header, sizeof(header));
+        out += sizeof(header);
+        for (size_t index = 0; index < par_count && used != NULL; index++)
+        {
+            if (!(used[index / 8] & (1 << (index % 8))))
+                continue;
+            pp_t pp = pp_get_par(index);
+            const char *name = pp_get_name(pp);
+            size_t len = strnlen(name, 0xFF);
+            uint16_t type = pp_get_type(pp) & TYPE_ALL;
+            *out++ = index & 0xFF;
+            *out++ = index >> 8;
+            *out++ = type & 0xFF;
+            *out++ = type >> 8;
+            *out++ = len;
+            memcpy(out, name, len);
+            out += len;
+        }
+        memset(out, 0, RECORD_ALIGN(names) - names);
+        out += RECORD_ALIGN(names) - names;
+        memcpy(out, buffer, buffer_used);
+        ok = true;
+    }
+    *size = needed;
+    pp_free(used);
+
+    portENTER_CRITICAL(&record_lock);
+    pp_record_active = was_active;
+    portEXIT_CRITICAL(&record_lock);
+    return ok;
+}
+
+static bool replay_post(pp_t pp, parameter_type_t type, const uint8_t *value, uint32_t size)
+{
+    switch (type)
+    {
+    case TYPE_INT32:
+    {
+        int32_t i;
+        if (size != sizeof(i))
+            return false;
+        memcpy(&i, value, sizeof(i));
+        return pp_post_newstate_int32(pp, i);
+    }
+    case TYPE_INT64:
+    {
+        int64_t i;
+        if (size != sizeof(i))
+            return false;
+        memcpy(&i, value, sizeof(i));
+        return pp_post_newstate_int64(pp, i);
+    }
+    case TYPE_FLOAT:
+    {
+        float f;
+        if (size != sizeof(f))
+            return false;
+        memcpy(&f, value, sizeof(f));
+        return pp_post_newstate_float(pp, f);
+    }
+    case TYPE_BOOL:
+        return size == 1 && pp_post_newstate_bool(pp, value[0] != 0);
+    case TYPE_STRING:
+        return size > 0 && value[size - 1] == 0 && pp_post_newstate_string(pp, (const char *)value);
+    case TYPE_BINARY:
+        return pp_post_newstate_binary(pp, (void *)value, size);
+    case TYPE_FLOAT_ARRAY:
+    {
+        pp_float_array_t *array = pp_allocate_float_array(size / sizeof(float));
+        if (array == NULL)
+            return false;
+        memcpy(array->data, value, array->len * sizeof(float));
+        bool ok = pp_post_newstate_float_array(pp, array);
+        pp_free(array);
+        return ok;
+    }
+    default:
+        return false;
+    }
+}
+
+/// @brief Wait until the time given by esp_timer_get_time(), sleeping whole ticks and spinning the rest.
+static void replay_wait_until(int64_t target_us)
+{
+    int64_t remaining;
+    while ((remaining = target_us - esp_timer_get_time()) > 0)
+    {
+        if (remaining >= portTICK_PERIOD_MS * 1000)
+            vTaskDelay(remaining / (portTICK_PERIOD_MS * 1000));
+    }
+}
+
+bool pp_replay(const void *dump, size_t size, float speed, pp_replay_stats_t *stats)
+{
+    const uint8_t *in = (const uint8_t *)dump;
+    uint32_t header[6];
+    if (dump == NULL || size < sizeof(header))
+        return false;
+    memcpy(header, in, sizeof(header));
+    if (header[0] != PP_RECORD_MAGIC || header[1] != RECORD_VERSION)
+    {
+        ESP_LOGE(TAG, "%s: Not a recording", __func__);
+        return false;
+    }
+    uint32_t count = header[2];
+    uint32_t param_count = header[3];
+    size_t data_size = header[5];
+
+    // Map the recorded indices to the parameters of this run, by name
+    size_t offset = sizeof(header);
+    size_t max_index = 0;
+    for (uint32_t i = 0, o = offset; i < param_count; i++)
+    {
+        if (o + 5 > size || o + 5 + in[o + 4] > size)
+            return false;
+        size_t index = in[o] | (in[o + 1] << 8);
+        if (index > max_index)
+            max_index = index;
+        o += 5 + in[o + 4];
+    }
+    size_t map_size = (max_index + 1) * (sizeof(pp_t) + sizeof(parameter_type_t));
+    pp_t *map = (pp_t *)pp_mem_alloc(PP_MEM_MODULES, map_size);
+    if (map == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate %d bytes", __func__, map_size);
+        return false;
+    }
+    parameter_type_t *types = (parameter_type_t *)(map + max_index + 1);
+    memset(map, 0, map_size);
+    size_t names = 0;
+    for (uint32_t i = 0; i < param_count; i++)
+    {
+        const uint8_t *entry = in + offset + names;
+        size_t index = entry[0] | (entry[1] << 8);
+        parameter_type_t type = (parameter_type_t)(entry[2] | (entry[3] << 8));
+        char name[0x100];
+        memcpy(name, entry + 5, entry[4]);
+        name[entry[4]] = 0;
+        names += 5 + entry[4];
+        pp_t pp = pp_get(name);
+        if (pp != NULL && (pp_get_type(pp) & TYPE_ALL) == type)
+        {
+            map[index] = pp;
+            types[index] = type;
+        }
+        else
+            ESP_LOGW(TAG, "%s: %s is not a parameter of the recorded type, skipped", __func__, name);
+    }
+    offset += RECORD_ALIGN(names);
+    if (offset + data_size > size)
+    {
+        pp_free(map);
+        return false;
+    }
+
+    pp_replay_stats_t result = {};
+    int64_t begin = esp_timer_get_time();
+    const uint8_t *data = in + offset;
+    for (size_t o = 0; count > 0 && o + sizeof(record_entry_t) <= data_size; count--)
+    {
+        record_entry_t e;
+        memcpy(&e, data + o, sizeof(e));
+        const uint8_t *value = data + o + sizeof(e);
+        // A size beyond the data ends the replay, the following entries can not be found
+        if (e.size > data_size - o - sizeof(e))
+        {
+            result.skipped += count;
+            break;
+        }
+        o += sizeof(e) + RECORD_ALIGN(e.size);
+        if (e.index > max_index || map[e.index] == NULL)
+        {
+            result.skipped++;
+            continue;
+        }
+        if (speed > 0)
+        {
+            uint64_t time_us = ((uint64_t)e.time_us_high << 32) | e.time_us_low;
+            int64_t target = begin + (int64_t)(time_us / speed);
+            replay_wait_until(target);
+            int64_t lag = esp_timer_get_time() - target;
+            if (lag > result.max_lag_us)
+                result.max_lag_us = lag;
+        }
+        if (replay_post(map[e.index], types[e.index], value, e.size))
+            result.posts++;
+        else
+            result.failed++;
+    }
+    result.duration_us = esp_timer_get_time() - begin;
+    uint32_t attempted = result.posts + result.failed;
+    result.rate_hz = result.duration_us > 0 ? attempted * 1e6f / result.duration_us : 0.0f;
+    pp_free(map);
+    if (stats != NULL)
+        *stats = result;
+    return true;
+}
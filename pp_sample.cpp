@@ -0,0 +1,254 @@
+#include <string.h>
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_event.h"
+#include "pp.h"
+#include "pp_sample.h"
+#include "pp_internal.h"
+
+typedef struct
+{
+    pp_t pp; ///< NULL if the entry is free.
+    uint32_t period_ticks;
+    bool on_change;
+    /// @brief True if last holds the last posted value.
+    bool posted;
+    pp_value_t last;
+    /// @brief Changed by every attach, a sample taken before does not update posted and last.
+    uint32_t generation;
+} sample_entry_t;
+
+/// @brief A copy of a due entry, read and posted without the lock.
+typedef struct
+{
+    sample_entry_t *entry;
+    pp_t pp;
+    uint32_t generation;
+    bool on_change;
+    bool posted;
+    pp_value_t last;
+} sample_due_t;
+
+static sample_entry_t entries[PP_SAMPLE_MAX_PARAMETERS];
+static esp_timer_handle_t sample_timer = NULL;
+/// @brief Reads and posts the due parameters, so posts that wait for a full queue do not block the esp_timer task.
+static esp_event_loop_handle_t sample_loop = NULL;
+static const char *SAMPLE_BASE = "pp_sample";
+static uint32_t tick_ms = PP_SAMPLE_DEFAULT_TICK_MS;
+static uint32_t tick = 0;
+static portMUX_TYPE lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *TAG = "PP_SAMPLE";
+
+static bool sample_read(pp_t pp, parameter_type_t type, pp_value_t *value)
+{
+    const void *valueptr = pp_get_valueptr(pp);
+    if (valueptr == NULL)
+        return false;
+    memset(value, 0, sizeof(*value));
+    switch (type)
+    {
+    case TYPE_INT32:
+        value->i32 = *(const int32_t *)valueptr;
+        return true;
+    case TYPE_INT64:
+        value->i64 = *(const int64_t *)valueptr;
+        return true;
+    case TYPE_FLOAT:
+        value->f = *(const float *)valueptr;
+        return true;
+    case TYPE_BOOL:
+        value->b = *(const bool *)valueptr;
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool sample_post(pp_t pp, parameter_type_t type, const pp_value_t *value)
+{
+    switch (type)
+    {
+    case TYPE_INT32:
+        return pp_post_newstate_int32(pp, value->i32);
+    case TYPE_INT64:
+        return pp_post_newstate_int64(pp, value->i64);
+    case TYPE_FLOAT:
+        return pp_post_newstate_float(pp, value->f);
+    case TYPE_BOOL:
+        return pp_post_newstate_bool(pp, value->b);
+    default:
+        return false;
+    }
+}
+
+/// @brief Store the result of a sample if the entry was not attached again meanwhile.
+static void sample_update(const sample_due_t *due, bool posted, const pp_value_t *last)
+{
+    portENTER_CRITICAL(&lock);
+    sample_entry_t *e = due->entry;
+    if (e->pp == due->pp && e->generation == due->generation)
+    {
+        e->posted = posted;
+        if (last != NULL)
+            e->last = *last;
+    }
+    portEXIT_CRITICAL(&lock);
+}
+
+static void sample_tick_event(void *handler_arg, esp_event_base_t base, int32_t id, void *event_data)
+{
+    uint32_t now = *(uint32_t *)event_data;
+    sample_due_t due[PP_SAMPLE_MAX_PARAMETERS];
+    size_t count = 0;
+
+    portENTER_CRITICAL(&lock);
+    for (size_t i = 0; i < PP_SAMPLE_MAX_PARAMETERS; i++)
+    {
+        sample_entry_t *e = &entries[i];
+        if (e->pp != NULL && now % e->period_ticks == 0)
+            due[count++] = {e, e->pp, e->generation, e->on_change, e->posted, e->last};
+    }
+    portEXIT_CRITICAL(&lock);
+
+    // Read and post outside the lock, attach and detach may reuse an entry meanwhile
+    for (size_t i = 0; i < count; i++)
+    {
+        parameter_type_t type = (parameter_type_t)(pp_get_type(due[i].pp) & TYPE_ALL);
+        if (type == TYPE_UNKNOWN)
+        {
+            // Deleted, its handle no longer resolves
+            pp_sample_detach(due[i].pp);
+            continue;
+        }
+        pp_demand_t demand;
+        if (pp_get_demand(due[i].pp, &demand) && demand.subscribers == 0)
+        {
+            sample_update(&due[i], false, NULL);
+            continue;
+        }
+        pp_value_t value;
+        if (!sample_read(due[i].pp, type, &value))
+            continue;
+        if (due[i].on_change && due[i].posted && memcmp(&value, &due[i].last, sizeof(value)) == 0)
+            continue;
+        if (sample_post(due[i].pp, type, &value))
+            sample_update(&due[i], true, &value);
+    }
+}
+
+static void sample_timer_cb(void *arg)
+{
+    portENTER_CRITICAL(&lock);
+    uint32_t now = ++tick;
+    portEXIT_CRITICAL(&lock);
+    // Only signal the sample task. A tick it has no room for is skipped, samples are not delivered late.
+    esp_event_post_to(sample_loop, SAMPLE_BASE, 0, &now, sizeof(now), 0);
+}
+
+bool pp_sample_init(uint32_t ms)
+{
+    if (sample_timer != NULL)
+    {
+        ESP_LOGW(TAG, "%s: Already initialized", __func__);
+        return false;
+    }
+    tick_ms = (ms > 0) ? ms : PP_SAMPLE_DEFAULT_TICK_MS;
+
+    esp_event_loop_args_t loop_args = {};
+    loop_args.queue_size = 2;
+    loop_args.task_name = "pp_sample";
+    loop_args.task_priority = PP_SAMPLE_TASK_PRIORITY;
+    loop_args.task_stack_size = PP_SAMPLE_TASK_STACK_SIZE;
+    loop_args.task_core_id = tskNO_AFFINITY;
+    if (sample_loop == NULL && (esp_event_loop_create(&loop_args, &sample_loop) != ESP_OK ||
+                                esp_event_handler_register_with(sample_loop, SAMPLE_BASE, 0, sample_tick_event, NULL) != ESP_OK))
+    {
+        ESP_LOGE(TAG, "%s: Failed to create sample task", __func__);
+        return false;
+    }
+
+    esp_timer_create_args_t args = {};
+    args.callback = sample_timer_cb;
+    args.name = "pp_sample";
+    if (esp_timer_create(&args, &sample_timer) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: Failed to create timer", __func__);
+        return false;
+    }
+    if (esp_timer_start_periodic(sample_timer, (uint64_t)tick_ms * 1000) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "%s: Failed to start timer", __func__);
+        esp_timer_delete(sample_timer);
+        sample_timer = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool pp_sample_attach(pp_t pp, uint32_t period_ms, bool on_change)
+{
+    parameter_type_t type = (parameter_type_t)(pp_get_type(pp) & TYPE_ALL);
+    if (type != TYPE_INT32 && type != TYPE_INT64 && type != TYPE_FLOAT && type != TYPE_BOOL)
+    {
+        ESP_LOGE(TAG, "%s: %s is not a scalar parameter", __func__, pp_get_name(pp));
+        return false;
+    }
+    if (pp_get_valueptr(pp) == NULL)
+    {
+        ESP_LOGE(TAG, "%s: %s has no value pointer", __func__, pp_get_name(pp));
+        return false;
+    }
+    uint32_t period_ticks = (period_ms + tick_ms - 1) / tick_ms;
+    if (period_ticks == 0)
+        period_ticks = 1;
+
+    sample_entry_t *free_entry = NULL;
+    portENTER_CRITICAL(&lock);
+    for (size_t i = 0; i < PP_SAMPLE_MAX_PARAMETERS; i++)
+    {
+        if (entries[i].pp == pp)
+        {
+            free_entry = &entries[i];
+            break;
+        }
+        if (entries[i].pp == NULL && free_entry == NULL)
+            free_entry = &entries[i];
+    }
+    if (free_entry != NULL)
+    {
+        free_entry->pp = pp;
+        free_entry->period_ticks = period_ticks;
+        free_entry->on_change = on_change;
+        free_entry->posted = false;
+        free_entry->generation++;
+    }
+    portEXIT_CRITICAL(&lock);
+
+    if (free_entry == NULL)
+    {
+        ESP_LOGE(TAG, "%s: No free entry for %s", __func__, pp_get_name(pp));
+        return false;
+    }
+    if (sample_timer == NULL)
+        ESP_LOGW(TAG, "%s: %s is not sampled until pp_sample_init() is called", __func__, pp_get_name(pp));
+    return true;
+}
+
+bool pp_sample_detach(pp_t pp)
+{
+    bool found = false;
+    portENTER_CRITICAL(&lock);
+    for (size_t i = 0; i < PP_SAMPLE_MAX_PARAMETERS; i++)
+    {
+        if (entries[i].pp == pp)
+        {
+            entries[i].pp = NULL;
+            found = true;
+        }
+    }
+    portEXIT_CRITICAL(&lock);
+    return found;
+}
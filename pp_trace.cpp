@@ -0,0 +1,192 @@
+#include <string.h>
+#include <esp_log.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+#include "pp.h"
+#include "pp_trace.h"
+#include "pp_internal.h"
+
+#define TRACE_VERSION 1
+
+volatile bool pp_trace_active = false;
+
+static pp_trace_entry_t *ring = NULL;
+static size_t ring_size = 0;
+static size_t ring_head = 0;
+static size_t ring_count = 0;
+static const char *receivers[PP_TRACE_MAX_RECEIVERS];
+static size_t receiver_count = 0;
+// Recording as requested by start and stop, pp_trace_active is also cleared while a dump copies the ring
+static bool recording = false;
+static int dumping = 0;
+static portMUX_TYPE trace_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static const char *TAG = "PP_TRACE";
+
+/// @brief Index of the receiver in the receiver table, added if new. Call with trace_lock held.
+static uint8_t trace_receiver(const pp_evloop_t *receiver)
+{
+    if (receiver == NULL)
+        return 0xFF;
+    for (size_t i = 0; i < receiver_count; i++)
+        if (receivers[i] == receiver->base)
+            return i;
+    if (receiver_count >= PP_TRACE_MAX_RECEIVERS)
+        return 0xFF;
+    receivers[receiver_count] = receiver->base;
+    return receiver_count++;
+}
+
+void pp_trace_record(uint8_t kind, int index, const pp_evloop_t *receiver, size_t size, bool ok, int64_t start_us)
+{
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL_SAFE(&trace_lock);
+    if (pp_trace_active)
+    {
+        pp_trace_entry_t *e = &ring[ring_head];
+        e->timestamp_us = (uint32_t)start_us;
+        e->duration_us = (uint32_t)(now - start_us);
+        e->param = (index < 0) ? PP_TRACE_NO_PARAM : index;
+        e->size = (size > 0xFFFF) ? 0xFFFF : size;
+        e->kind = kind;
+        e->receiver = trace_receiver(receiver);
+        e->result = ok ? 0 : 1;
+        e->core = xPortGetCoreID();
+        ring_head = (ring_head + 1) % ring_size;
+        if (ring_count < ring_size)
+            ring_count++;
+    }
+    portEXIT_CRITICAL_SAFE(&trace_lock);
+}
+
+bool pp_trace_start(size_t entries)
+{
+    if (entries == 0)
+        return false;
+    pp_trace_stop();
+    pp_trace_entry_t *buf = (pp_trace_entry_t *)pp_mem_alloc(PP_MEM_MODULES, entries * sizeof(pp_trace_entry_t));
+    if (buf == NULL)
+    {
+        ESP_LOGE(TAG, "%s: Failed to allocate %d entries", __func__, entries);
+        return false;
+    }
+    memset(buf, 0, entries * sizeof(pp_trace_entry_t));
+    pp_trace_entry_t *old;
+    portENTER_CRITICAL(&trace_lock);
+    if (dumping > 0)
+    {
+        portEXIT_CRITICAL(&trace_lock);
+        ESP_LOGE(TAG, "%s: A dump is in progress", __func__);
+        pp_free(buf);
+        return false;
+    }
+    old = ring;
+    ring = buf;
+    ring_size = entries;
+    ring_head = 0;
+    ring_count = 0;
+    receiver_count = 0;
+    recording = true;
+    pp_trace_active = true;
+    portEXIT_CRITICAL(&trace_lock);
+    pp_free(old);
+    return true;
+}
+
+void pp_trace_stop(void)
+{
+    portENTER_CRITICAL(&trace_lock);
+    recording = false;
+    pp_trace_active = false;
+    portEXIT_CRITICAL(&trace_lock);
+}
+
+bool pp_trace_dump(void *buf, size_t *size)
+{
+    if (size == NULL)
+        return false;
+
+    // The ring stays allocated while dumping is set, pp_trace_start() refuses to replace it
+    portENTER_CRITICAL(&trace_lock);
+    if (ring == NULL)
+    {
+        portEXIT_CRITICAL(&trace_lock);
+        return false;
+    }
+    dumping++;
+    pp_trace_active = false;
+    const pp_trace_entry_t *entries = ring;
+    size_t capacity = ring_size;
+    size_t head = ring_head;
+    size_t count = ring_count;
+    size_t receivers_used = receiver_count;
+    portEXIT_CRITICAL(&trace_lock);
+
+    // Only parameters that appear in the trace get a name
+    size_t par_count = 0;
+    while (pp_get_par(par_count) != NULL)
+        par_count++;
+    size_t used_size = (par_count + 7) / 8 + 1;
+    uint8_t *used = (uint8_t *)pp_mem_alloc(PP_MEM_MODULES, used_size);
+    if (used != NULL)
+        memset(used, 0, used_size);
+    size_t needed = 5 * sizeof(uint32_t);
+    uint32_t param_count = 0;
+    for (size_t i = 0; i < count && used != NULL; i++)
+    {
+        uint16_t index = entries[(head + capacity - count + i) % capacity].param;
+        if (index >= par_count || (used[index / 8] & (1 << (index % 8))))
+            continue;
+        const char *name = pp_get_name(pp_get_par(index));
+        if (name == NULL)
+            continue;
+        used[index / 8] |= 1 << (index % 8);
+        needed += 3 + strnlen(name, 0xFF);
+        param_count++;
+    }
+    for (size_t i = 0; i < receivers_used; i++)
+        needed += 1 + strnlen(receivers[i], 0xFF);
+    needed += count * sizeof(pp_trace_entry_t);
+
+    bool ok = false;
+    if (buf != NULL && *size >= needed)
+    {
+        uint8_t *out = (uint8_t *)buf;
+        uint32_t header[5] = {PP_TRACE_MAGIC, TRACE_VERSION, (uint32_t)count, (uint32_t)receivers_used, param_count};
+        memcpy(out, header, sizeof(header));
+        out += sizeof(header);
+        for (size_t i = 0; i < receivers_used; i++)
+        {
+            size_t len = strnlen(receivers[i], 0xFF);
+            *out++ = len;
+            memcpy(out, receivers[i], len);
+            out += len;
+        }
+        for (size_t index = 0; index < par_count && used != NULL; index++)
+        {
+            if (!(used[index / 8] & (1 << (index % 8))))
+                continue;
+            const char *name = pp_get_name(pp_get_par(index));
+            size_t len = strnlen(name, 0xFF);
+            *out++ = index & 0xFF;
+            *out++ = index >> 8;
+            *out++ = len;
+            memcpy(out, name, len);
+            out += len;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            memcpy(out, &entries[(head + capacity - count + i) % capacity], sizeof(pp_trace_entry_t));
+            out += sizeof(pp_trace_entry_t);
+        }
+        ok = true;
+    }
+    *size = needed;
+    pp_free(used);
+
+    portENTER_CRITICAL(&trace_lock);
+    dumping--;
+    pp_trace_active = recording && dumping == 0;
+    portEXIT_CRITICAL(&trace_lock);
+    return ok;
+}
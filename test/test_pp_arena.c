@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include "unity.h"
+#include "pp.h"
+
+#define ARENA_REGION_SIZE 65536
+#define ARENA_ROUND(size) (((size) + 7) / 8 * 8)
+
+static uint8_t region[ARENA_REGION_SIZE] __attribute__((aligned(8)));
+static pp_evloop_t loop = {.loop_handle = NULL, .base = "pp_arena_test"};
+static int32_t value;
+static int mallocs;
+static int malloc_ok; ///< Bit n set lets the n-th malloc succeed.
+static size_t malloc_size; ///< Size of the last successful malloc.
+
+static void *counting_malloc(size_t size)
+{
+    bool ok = (malloc_ok >> mallocs++) & 1;
+    if (ok)
+        malloc_size = size;
+    return ok ? malloc(size) : NULL;
+}
+
+static void *failing_calloc(size_t size, size_t count)
+{
+    return NULL;
+}
+
+/// @brief Create the first parameter, it fails after allocating the tables the mask lets through.
+static void create_failing(int ok_mask)
+{
+    mallocs = 0;
+    malloc_ok = ok_mask;
+    TEST_ASSERT_NULL(pp_create_int32("arena_test/first", &loop, NULL, &value));
+    pp_memory_stats_t stats;
+    pp_get_memory_stats(&stats);
+    TEST_ASSERT_EQUAL(0, stats.allocations);
+    TEST_ASSERT_EQUAL(0, stats.arena_used);
+}
+
+TEST_CASE("a failed first create gives the parameter table back to the arena", "[pp_arena]")
+{
+    pp_memory_stats_t stats;
+    pp_get_memory_stats(&stats);
+    if (stats.allocations > 0 || stats.arena_size > 0)
+        TEST_IGNORE_MESSAGE("needs a fresh boot, run it on its own");
+
+    pp_hooks hooks = {counting_malloc, failing_calloc, free};
+    pp_init_hooks(&hooks);
+    // The parameter table is allocated first, the second table fails
+    create_failing(1);
+    size_t table_size = malloc_size;
+    TEST_ASSERT_GREATER_THAN(PP_ARENA_MAX_BLOCK, table_size);
+
+    // The parameter table fills the arena, the live table does not fit and the heap fails
+    TEST_ASSERT_TRUE(pp_init_arena(region, ARENA_ROUND(table_size)));
+    create_failing(0);
+    // Twice, the first failure must not have left the table in a free list
+    create_failing(0);
+
+    TEST_ASSERT_TRUE(pp_init_arena(region, ARENA_REGION_SIZE));
+    malloc_ok = 0;
+    pp_t p = pp_create_int32("arena_test/first", &loop, NULL, &value);
+    TEST_ASSERT_NOT_NULL(p);
+    pp_get_memory_stats(&stats);
+    TEST_ASSERT_GREATER_THAN(table_size, stats.arena_used);
+
+    pp_hooks heap = {malloc, calloc, free};
+    pp_init_hooks(&heap);
+    pp_delete(p);
+}
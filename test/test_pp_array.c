@@ -0,0 +1,150 @@
+#include <math.h>
+#include "unity.h"
+#include "esp_event.h"
+#include "pp.h"
+#include "pp_array.h"
+
+#define ARRAY_LEN 16
+
+static pp_evloop_t owner = {.base = "array_test_owner"};
+static pp_evloop_t receiver = {.base = "array_test"};
+static pp_float_array_t *decoded;
+static uint32_t sequence;
+static int frames;
+static int decoded_frames;
+static int keyframes;
+static bool drop;
+
+static void array_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    const pp_array_frame_t *frame = (const pp_array_frame_t *)event_data;
+    frames++;
+    keyframes += frame->keyframe;
+    if (drop)
+        return;
+    if (pp_array_decode(frame, decoded, ARRAY_LEN, &sequence))
+        decoded_frames++;
+}
+
+static pp_t create_encoded(const char *name, const pp_array_encoding_t *encoding)
+{
+    esp_event_loop_args_t args = {.queue_size = 8, .task_name = NULL};
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_create(&args, &owner.loop_handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_create(&args, &receiver.loop_handle));
+    pp_t pp = pp_create_float_array(name, &owner, NULL);
+    TEST_ASSERT_TRUE(pp_set_array_encoding(pp, encoding));
+    TEST_ASSERT_TRUE(pp_subscribe(pp, &receiver, array_event));
+    decoded = pp_allocate_float_array(ARRAY_LEN);
+    decoded->len = 0;
+    sequence = 0;
+    frames = decoded_frames = keyframes = 0;
+    drop = false;
+    return pp;
+}
+
+static void delete_encoded(pp_t pp)
+{
+    pp_unsubscribe(pp, &receiver, array_event);
+    pp_delete(pp);
+    pp_free(decoded);
+    esp_event_loop_delete(owner.loop_handle);
+    esp_event_loop_delete(receiver.loop_handle);
+}
+
+static void post(pp_t pp, pp_float_array_t *array)
+{
+    TEST_ASSERT_TRUE(pp_post_newstate_float_array(pp, array));
+    esp_event_loop_run(receiver.loop_handle, 0);
+}
+
+TEST_CASE("int16 arrays round trip within half a step", "[pp_array]")
+{
+    pp_array_encoding_t encoding = {.kind = PP_ARRAY_INT16, .scale = 0.01f, .offset = 100.0f};
+    pp_t pp = create_encoded("array_test/int16", &encoding);
+    pp_float_array_t *array = pp_allocate_float_array(ARRAY_LEN);
+    for (int i = 0; i < ARRAY_LEN; i++)
+        array->data[i] = 100.0f + (i - 8) * 12.345f;
+    // Out of range values are clamped, NaN is kept
+    array->data[0] = 1e6f;
+    array->data[1] = -1e6f;
+    array->data[2] = INFINITY;
+    array->data[3] = NAN;
+    post(pp, array);
+
+    TEST_ASSERT_EQUAL(1, decoded_frames);
+    TEST_ASSERT_EQUAL(ARRAY_LEN, decoded->len);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 100.0f + INT16_MAX * 0.01f, decoded->data[0]);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 100.0f + (INT16_MIN + 1) * 0.01f, decoded->data[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.01f, 100.0f + INT16_MAX * 0.01f, decoded->data[2]);
+    TEST_ASSERT_TRUE(isnan(decoded->data[3]));
+    for (int i = 4; i < ARRAY_LEN; i++)
+        TEST_ASSERT_FLOAT_WITHIN(0.005f + 1e-4f, array->data[i], decoded->data[i]);
+
+    pp_free(array);
+    delete_encoded(pp);
+}
+
+TEST_CASE("sparse arrays wait for a keyframe after a missed frame", "[pp_array]")
+{
+    pp_array_encoding_t encoding = {.kind = PP_ARRAY_SPARSE, .threshold = 0.0f, .keyframe_interval = 4};
+    pp_t pp = create_encoded("array_test/sparse", &encoding);
+    pp_float_array_t *array = pp_allocate_float_array(ARRAY_LEN);
+    for (int i = 0; i < ARRAY_LEN; i++)
+        array->data[i] = i;
+
+    // The new subscriber gets a keyframe, then the changed element only
+    post(pp, array);
+    TEST_ASSERT_EQUAL(1, keyframes);
+    array->data[5] = 50.0f;
+    post(pp, array);
+    TEST_ASSERT_EQUAL(1, keyframes);
+    TEST_ASSERT_EQUAL(2, decoded_frames);
+    TEST_ASSERT_EQUAL_MEMORY(array->data, decoded->data, ARRAY_LEN * sizeof(float));
+
+    // A missed frame leaves the next sparse frame undecodable until the keyframe
+    drop = true;
+    array->data[6] = 60.0f;
+    post(pp, array);
+    drop = false;
+    array->data[7] = 70.0f;
+    post(pp, array);
+    TEST_ASSERT_EQUAL(4, frames);
+    TEST_ASSERT_EQUAL(2, decoded_frames);
+    TEST_ASSERT_EQUAL_FLOAT(6.0f, decoded->data[6]);
+
+    array->data[8] = 80.0f;
+    post(pp, array);
+    TEST_ASSERT_EQUAL(2, keyframes);
+    TEST_ASSERT_EQUAL(3, decoded_frames);
+    TEST_ASSERT_EQUAL_MEMORY(array->data, decoded->data, ARRAY_LEN * sizeof(float));
+
+    pp_free(array);
+    delete_encoded(pp);
+}
+
+TEST_CASE("sparse arrays under the threshold do not drift", "[pp_array]")
+{
+    const float threshold = 0.5f;
+    pp_array_encoding_t encoding = {.kind = PP_ARRAY_SPARSE, .threshold = threshold, .keyframe_interval = 1000};
+    pp_t pp = create_encoded("array_test/threshold", &encoding);
+    pp_float_array_t *array = pp_allocate_float_array(ARRAY_LEN);
+    for (int i = 0; i < ARRAY_LEN; i++)
+        array->data[i] = 0.0f;
+    post(pp, array);
+
+    // Steps below the threshold add up, the decoded value follows within the threshold
+    for (int n = 1; n <= 40; n++)
+    {
+        array->data[0] = n * 0.3f;
+        array->data[1] = -n * 0.2f;
+        post(pp, array);
+        TEST_ASSERT_EQUAL(n + 1, decoded_frames);
+        TEST_ASSERT_FLOAT_WITHIN(threshold, array->data[0], decoded->data[0]);
+        TEST_ASSERT_FLOAT_WITHIN(threshold, array->data[1], decoded->data[1]);
+        TEST_ASSERT_EQUAL_FLOAT(0.0f, decoded->data[2]);
+    }
+    TEST_ASSERT_EQUAL(1, keyframes);
+
+    pp_free(array);
+    delete_encoded(pp);
+}
@@ -0,0 +1,187 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "unity.h"
+#include "esp_event.h"
+#include "pp.h"
+#include "pp_bridge.h"
+#include "pp_array.h"
+
+static esp_event_loop_handle_t loop_a;
+static esp_event_loop_handle_t loop_b;
+static pp_evloop_t evloop_a = {.base = "bridge_test_a"};
+static pp_evloop_t evloop_b = {.base = "bridge_test_b"};
+static int32_t written = 0;
+
+static void speed_write(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    written = *(int32_t *)event_data;
+}
+
+/// @brief Create two loops without a task, the tests run them with esp_event_loop_run().
+static void create_loops(void)
+{
+    esp_event_loop_args_t args = {.queue_size = 16, .task_name = NULL};
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_create(&args, &loop_a));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_create(&args, &loop_b));
+    evloop_a.loop_handle = loop_a;
+    evloop_b.loop_handle = loop_b;
+}
+
+static void delete_loops(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_delete(loop_a));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_delete(loop_b));
+}
+
+static void pump(pp_bridge_t *a, pp_bridge_t *b)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        esp_event_loop_run(loop_a, 0);
+        if (a != NULL)
+            TEST_ASSERT_TRUE(pp_bridge_poll(a));
+        esp_event_loop_run(loop_b, 0);
+        TEST_ASSERT_TRUE(pp_bridge_poll(b));
+    }
+}
+
+/// @brief Send a frame as a remote bridge would, see the frame layout in pp_bridge.cpp.
+static void send_frame(int fd, uint8_t type, const uint8_t *payload, size_t len)
+{
+    uint8_t frame[64] = {0xA5, 0x5A, type, len & 0xFF, len >> 8};
+    uint8_t sum = type + (len & 0xFF) + (len >> 8);
+    memcpy(&frame[5], payload, len);
+    for (size_t i = 0; i < len; i++)
+        sum += payload[i];
+    frame[5 + len] = ~sum;
+    TEST_ASSERT_EQUAL(6 + len, write(fd, frame, 6 + len));
+}
+
+TEST_CASE("bridge mirrors values and writes over a socketpair", "[pp_bridge][linux]")
+{
+    static int32_t speed = 0;
+    int fds[2];
+    pp_bridge_transport_t ta, tb;
+
+    create_loops();
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    TEST_ASSERT_TRUE(pp_bridge_fd_transport(&ta, fds[0]));
+    TEST_ASSERT_TRUE(pp_bridge_fd_transport(&tb, fds[1]));
+    pp_bridge_t *a = pp_bridge_create(&ta, &evloop_a, NULL);
+    pp_bridge_t *b = pp_bridge_create(&tb, &evloop_b, "node_a/");
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+
+    pp_t pspeed = pp_create_int32("bridge_test/speed", &evloop_a, speed_write, &speed);
+    pp_t pspectrum = pp_create_float_array("bridge_test/spectrum", &evloop_a, NULL);
+    TEST_ASSERT_TRUE(pp_bridge_export(a, pspeed));
+    TEST_ASSERT_TRUE(pp_bridge_export(a, pspectrum));
+
+    speed = 42;
+    pp_post_newstate_int32(pspeed, speed);
+    pp_float_array_t *array = pp_allocate_float_array(3);
+    array->data[0] = 1.0f;
+    array->data[1] = -2.5f;
+    array->data[2] = 1e6f;
+    pp_post_newstate_float_array(pspectrum, array);
+    pump(a, b);
+
+    pp_t proxy_speed = pp_get("node_a/bridge_test/speed");
+    pp_t proxy_spectrum = pp_get("node_a/bridge_test/spectrum");
+    TEST_ASSERT_NOT_NULL(proxy_speed);
+    TEST_ASSERT_NOT_NULL(proxy_spectrum);
+    TEST_ASSERT_EQUAL(42, *(const int32_t *)pp_get_valueptr(proxy_speed));
+    const pp_float_array_t *mirrored = (const pp_float_array_t *)pp_get_valueptr(proxy_spectrum);
+    TEST_ASSERT_EQUAL(3, mirrored->len);
+    TEST_ASSERT_EQUAL_MEMORY(array->data, mirrored->data, 3 * sizeof(float));
+
+    // Writes to the proxy are posted to the exported parameter
+    TEST_ASSERT_TRUE(pp_post_write_int32(proxy_speed, 7));
+    pump(a, b);
+    TEST_ASSERT_EQUAL(7, written);
+
+    pp_free(array);
+    pp_bridge_delete(b);
+    pp_bridge_delete(a);
+    TEST_ASSERT_NULL(pp_get("node_a/bridge_test/speed"));
+    pp_delete(pspeed);
+    pp_delete(pspectrum);
+    close(fds[0]);
+    close(fds[1]);
+    delete_loops();
+}
+
+TEST_CASE("bridge refuses values with a size that does not match the type", "[pp_bridge][linux]")
+{
+    int fds[2];
+    pp_bridge_transport_t tb;
+
+    create_loops();
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    TEST_ASSERT_TRUE(pp_bridge_fd_transport(&tb, fds[1]));
+    pp_bridge_t *b = pp_bridge_create(&tb, &evloop_b, "peer/");
+
+    const uint8_t describe_count[] = {0, 0, TYPE_INT32 & 0xFF, TYPE_INT32 >> 8, 5, 'c', 'o', 'u', 'n', 't'};
+    const uint8_t describe_values[] = {1, 0, TYPE_FLOAT_ARRAY & 0xFF, TYPE_FLOAT_ARRAY >> 8, 6, 'v', 'a', 'l', 'u', 'e', 's'};
+    send_frame(fds[0], 1, describe_count, sizeof(describe_count));
+    send_frame(fds[0], 1, describe_values, sizeof(describe_values));
+    pump(NULL, b);
+    pp_t count = pp_get("peer/count");
+    pp_t values = pp_get("peer/values");
+    TEST_ASSERT_NOT_NULL(count);
+    TEST_ASSERT_NOT_NULL(values);
+
+    // An int32 of 2 bytes, and an array claiming 200 floats with data for 1
+    const uint8_t short_int[] = {0, 0, 2, 0, 0x11, 0x22};
+    const uint8_t long_array[] = {1, 0, 6, 0, 200, 0, 0, 0, 0x80, 0x3F};
+    send_frame(fds[0], 2, short_int, sizeof(short_int));
+    send_frame(fds[0], 2, long_array, sizeof(long_array));
+    pump(NULL, b);
+    TEST_ASSERT_EQUAL(0, *(const int32_t *)pp_get_valueptr(count));
+    TEST_ASSERT_EQUAL(0, ((const pp_float_array_t *)pp_get_valueptr(values))->len);
+
+    const uint8_t good_int[] = {0, 0, 4, 0, 5, 0, 0, 0};
+    const uint8_t good_array[] = {1, 0, 6, 0, 1, 0, 0, 0, 0x80, 0x3F};
+    send_frame(fds[0], 2, good_int, sizeof(good_int));
+    send_frame(fds[0], 2, good_array, sizeof(good_array));
+    pump(NULL, b);
+    TEST_ASSERT_EQUAL(5, *(const int32_t *)pp_get_valueptr(count));
+    const pp_float_array_t *received = (const pp_float_array_t *)pp_get_valueptr(values);
+    TEST_ASSERT_EQUAL(1, received->len);
+    TEST_ASSERT_EQUAL_FLOAT(1.0f, received->data[0]);
+
+    pp_bridge_delete(b);
+    close(fds[0]);
+    close(fds[1]);
+    delete_loops();
+}
+
+TEST_CASE("bridge and array encoding exclude each other", "[pp_bridge][linux]")
+{
+    int fds[2];
+    pp_bridge_transport_t ta;
+    pp_array_encoding_t encoding = {.kind = PP_ARRAY_INT16, .scale = 0.1f};
+
+    create_loops();
+    TEST_ASSERT_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    TEST_ASSERT_TRUE(pp_bridge_fd_transport(&ta, fds[0]));
+    pp_bridge_t *a = pp_bridge_create(&ta, &evloop_a, NULL);
+    pp_t encoded = pp_create_float_array("bridge_test/encoded", &evloop_a, NULL);
+    pp_t exported = pp_create_float_array("bridge_test/exported", &evloop_a, NULL);
+
+    TEST_ASSERT_TRUE(pp_set_array_encoding(encoded, &encoding));
+    TEST_ASSERT_FALSE(pp_bridge_export(a, encoded));
+    TEST_ASSERT_TRUE(pp_bridge_export(a, exported));
+    TEST_ASSERT_FALSE(pp_set_array_encoding(exported, &encoding));
+    TEST_ASSERT_EQUAL(PP_ARRAY_RAW, pp_get_array_encoding(exported));
+
+    // Encoding is possible again once the bridge is gone
+    pp_bridge_delete(a);
+    TEST_ASSERT_TRUE(pp_set_array_encoding(exported, &encoding));
+    pp_delete(encoded);
+    pp_delete(exported);
+    close(fds[0]);
+    close(fds[1]);
+    delete_loops();
+}
@@ -0,0 +1,163 @@
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include "unity.h"
+#include "esp_event.h"
+#include "pp.h"
+
+typedef struct
+{
+    pp_filter_kind_t kind;
+    double low;
+    double high;
+    double value; ///< Converted to the parameter type, int64 cases use value64.
+    int64_t value64;
+    bool pass;
+} filter_case_t;
+
+static pp_evloop_t owner = {.base = "filter_test_owner"};
+static pp_evloop_t receiver = {.base = "filter_test"};
+static int calls;
+
+static void filter_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    calls++;
+}
+
+static void create_loops(void)
+{
+    esp_event_loop_args_t args = {.queue_size = 8, .task_name = NULL};
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_create(&args, &owner.loop_handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_create(&args, &receiver.loop_handle));
+}
+
+static void delete_loops(void)
+{
+    esp_event_loop_delete(owner.loop_handle);
+    esp_event_loop_delete(receiver.loop_handle);
+}
+
+/// @brief Subscribe with each filter, post the value and check it is delivered only if it passes.
+static void run_cases(pp_t pp, const filter_case_t *cases, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const filter_case_t *c = &cases[i];
+        pp_filter_t filter = {.kind = c->kind, .low = c->low, .high = c->high};
+        TEST_ASSERT_TRUE(pp_subscribe_filter(pp, &receiver, filter_event, &filter));
+        switch (pp_get_type(pp) & TYPE_ALL)
+        {
+        case TYPE_INT32:
+            pp_post_newstate_int32(pp, (int32_t)c->value);
+            break;
+        case TYPE_INT64:
+            pp_post_newstate_int64(pp, c->value64);
+            break;
+        default:
+            pp_post_newstate_float(pp, (float)c->value);
+            break;
+        }
+        calls = 0;
+        esp_event_loop_run(receiver.loop_handle, 0);
+        if (calls != (c->pass ? 1 : 0))
+            printf("case %d: kind %d low %g high %g value %g\n", (int)i, c->kind, c->low, c->high, c->value);
+        TEST_ASSERT_EQUAL(c->pass ? 1 : 0, calls);
+        TEST_ASSERT_TRUE(pp_unsubscribe(pp, &receiver, filter_event));
+    }
+}
+
+TEST_CASE("int32 filter bounds compare exactly", "[pp_filter]")
+{
+    static int32_t value;
+    const filter_case_t cases[] = {
+        {PP_FILTER_ABOVE, 2.5, 0, 3, 0, true},
+        {PP_FILTER_ABOVE, 2.5, 0, 2, 0, false},
+        {PP_FILTER_BELOW, 2.5, 0, 2, 0, true},
+        {PP_FILTER_BELOW, 2.5, 0, 3, 0, false},
+        {PP_FILTER_BELOW, -2.5, 0, -3, 0, true},
+        {PP_FILTER_BELOW, -2.5, 0, -2, 0, false},
+        {PP_FILTER_EQUAL, 2.5, 0, 2, 0, false},
+        {PP_FILTER_EQUAL, 2.5, 0, 3, 0, false},
+        {PP_FILTER_EQUAL, 2.0, 0, 2, 0, true},
+        {PP_FILTER_ABOVE, -INFINITY, 0, INT32_MIN, 0, true},
+        {PP_FILTER_ABOVE, INFINITY, 0, INT32_MAX, 0, false},
+        {PP_FILTER_BELOW, INFINITY, 0, INT32_MAX, 0, true},
+        {PP_FILTER_BELOW, -INFINITY, 0, INT32_MIN, 0, false},
+        {PP_FILTER_ABOVE, 1e30, 0, INT32_MAX, 0, false},
+        {PP_FILTER_BELOW, -1e30, 0, INT32_MIN, 0, false},
+        {PP_FILTER_ENTER, -INFINITY, INFINITY, 0, 0, true},
+    };
+    create_loops();
+    pp_t pp = pp_create_int32("filter_test/int32", &owner, NULL, &value);
+    run_cases(pp, cases, sizeof(cases) / sizeof(cases[0]));
+
+    pp_filter_t nan_bound = {.kind = PP_FILTER_ABOVE, .low = NAN};
+    TEST_ASSERT_FALSE(pp_subscribe_filter(pp, &receiver, filter_event, &nan_bound));
+    pp_delete(pp);
+    delete_loops();
+}
+
+TEST_CASE("int64 filter bounds hold at the ends of the range", "[pp_filter]")
+{
+    static int64_t value;
+    // 2^63 is the first double past INT64_MAX, -2^63 is INT64_MIN
+    const double two63 = 9223372036854775808.0;
+    const filter_case_t cases[] = {
+        {PP_FILTER_ABOVE, 2.5, 0, 0, 3, true},
+        {PP_FILTER_ABOVE, 2.5, 0, 0, 2, false},
+        {PP_FILTER_BELOW, 2.5, 0, 0, 2, true},
+        {PP_FILTER_EQUAL, 2.5, 0, 0, 2, false},
+        {PP_FILTER_ABOVE, -INFINITY, 0, 0, INT64_MIN, true},
+        {PP_FILTER_ABOVE, -1e19, 0, 0, INT64_MIN, true},
+        {PP_FILTER_ABOVE, -two63, 0, 0, INT64_MIN, false},
+        {PP_FILTER_ABOVE, -two63, 0, 0, INT64_MIN + 1, true},
+        {PP_FILTER_BELOW, -two63, 0, 0, INT64_MIN, false},
+        {PP_FILTER_BELOW, -1e19, 0, 0, INT64_MIN, false},
+        {PP_FILTER_BELOW, INFINITY, 0, 0, INT64_MAX, true},
+        {PP_FILTER_BELOW, two63, 0, 0, INT64_MAX, true},
+        {PP_FILTER_ABOVE, two63, 0, 0, INT64_MAX, false},
+        {PP_FILTER_ABOVE, INFINITY, 0, 0, INT64_MAX, false},
+        {PP_FILTER_EQUAL, two63, 0, 0, INT64_MAX, false},
+        {PP_FILTER_EQUAL, -two63, 0, 0, INT64_MIN, true},
+        {PP_FILTER_ENTER, -INFINITY, INFINITY, 0, INT64_MAX, true},
+    };
+    create_loops();
+    pp_t pp = pp_create_int64("filter_test/int64", &owner, NULL, &value);
+    run_cases(pp, cases, sizeof(cases) / sizeof(cases[0]));
+    pp_delete(pp);
+    delete_loops();
+}
+
+TEST_CASE("float filter bounds handle infinity and NaN", "[pp_filter]")
+{
+    static float value;
+    const filter_case_t cases[] = {
+        {PP_FILTER_ABOVE, 2.5, 0, 2.5, 0, false},
+        {PP_FILTER_BELOW, 2.5, 0, 2.5, 0, false},
+        {PP_FILTER_EQUAL, 2.5, 0, 2.5, 0, true},
+        {PP_FILTER_ABOVE, 2.5, 0, 2.5000002, 0, true},
+        // 0.1f is a little above the double 0.1
+        {PP_FILTER_ABOVE, 0.1, 0, 0.1, 0, true},
+        {PP_FILTER_EQUAL, 0.1, 0, 0.1, 0, false},
+        {PP_FILTER_ABOVE, INFINITY, 0, INFINITY, 0, false},
+        {PP_FILTER_ABOVE, 1e300, 0, INFINITY, 0, true},
+        {PP_FILTER_ABOVE, 1e300, 0, FLT_MAX, 0, false},
+        {PP_FILTER_BELOW, INFINITY, 0, INFINITY, 0, false},
+        {PP_FILTER_BELOW, INFINITY, 0, FLT_MAX, 0, true},
+        {PP_FILTER_EQUAL, INFINITY, 0, INFINITY, 0, true},
+        {PP_FILTER_ABOVE, -INFINITY, 0, -INFINITY, 0, false},
+        {PP_FILTER_ABOVE, -INFINITY, 0, -FLT_MAX, 0, true},
+        {PP_FILTER_ENTER, -INFINITY, INFINITY, INFINITY, 0, true},
+        {PP_FILTER_ABOVE, -INFINITY, 0, NAN, 0, false},
+        {PP_FILTER_BELOW, INFINITY, 0, NAN, 0, false},
+        {PP_FILTER_ENTER, -INFINITY, INFINITY, NAN, 0, false},
+    };
+    create_loops();
+    pp_t pp = pp_create_float("filter_test/float", &owner, NULL, &value);
+    run_cases(pp, cases, sizeof(cases) / sizeof(cases[0]));
+
+    pp_filter_t nan_bound = {.kind = PP_FILTER_ENTER, .low = 0, .high = NAN};
+    TEST_ASSERT_FALSE(pp_subscribe_filter(pp, &receiver, filter_event, &nan_bound));
+    pp_delete(pp);
+    delete_loops();
+}
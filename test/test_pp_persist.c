@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <string.h>
+#include "unity.h"
+#include "esp_event.h"
+#include "pp.h"
+#include "pp_persist.h"
+
+#define PERSIST_PATH "pp_persist_test.bin"
+#define PERSIST_MAGIC 0x31535050
+
+static pp_evloop_t loop = {.loop_handle = NULL, .base = "pp_persist_test"};
+static pp_persist_backend_t file_backend;
+static int stores = 0;
+
+static bool counting_load(void *ctx, void *buf, size_t *size)
+{
+    return file_backend.load(file_backend.ctx, buf, size);
+}
+
+static bool counting_store(void *ctx, const void *buf, size_t size)
+{
+    stores++;
+    return file_backend.store(file_backend.ctx, buf, size);
+}
+
+TEST_CASE("file backend replaces and reads the record", "[pp_persist]")
+{
+    pp_persist_backend_t b;
+    const char record[] = "record";
+    char buf[16] = {0};
+    size_t size = 0;
+
+    remove(PERSIST_PATH);
+    TEST_ASSERT_TRUE(pp_persist_file_backend(&b, PERSIST_PATH));
+    TEST_ASSERT_FALSE(b.load(b.ctx, NULL, &size));
+    TEST_ASSERT_TRUE(b.store(b.ctx, record, sizeof(record)));
+    TEST_ASSERT_TRUE(b.load(b.ctx, NULL, &size));
+    TEST_ASSERT_EQUAL(sizeof(record), size);
+    TEST_ASSERT_TRUE(b.load(b.ctx, buf, &size));
+    TEST_ASSERT_EQUAL_STRING(record, buf);
+    remove(PERSIST_PATH);
+}
+
+TEST_CASE("flush coalesces changes and attach restores stored values", "[pp_persist]")
+{
+    static int32_t count = 0;
+    static float gain = 0;
+    uint32_t magic = 0;
+    size_t size = 0;
+
+    esp_event_loop_create_default();
+    remove(PERSIST_PATH);
+    pp_persist_file_backend(&file_backend, PERSIST_PATH);
+    pp_persist_backend_t counting = {NULL, counting_load, counting_store};
+    // Long delay, the test flushes itself
+    TEST_ASSERT_TRUE(pp_persist_init(&counting, 60000));
+
+    pp_t pcount = pp_create_int32("persist_test/count", &loop, NULL, &count);
+    pp_t pgain = pp_create_float("persist_test/gain", &loop, NULL, &gain);
+    TEST_ASSERT_TRUE(pp_persist_attach(pcount, 0));
+    TEST_ASSERT_TRUE(pp_persist_attach(pgain, 0));
+
+    count = 42;
+    gain = 1.5f;
+    pp_persist_mark_dirty(pcount);
+    pp_persist_mark_dirty(pgain);
+    pp_persist_mark_dirty(pcount);
+    TEST_ASSERT_TRUE(pp_persist_flush());
+    TEST_ASSERT_EQUAL(1, stores);
+    TEST_ASSERT_TRUE(pp_persist_flush());
+    TEST_ASSERT_EQUAL(1, stores);
+
+    TEST_ASSERT_TRUE(file_backend.load(file_backend.ctx, NULL, &size));
+    TEST_ASSERT_GREATER_THAN(sizeof(magic), size);
+    size = sizeof(magic);
+    TEST_ASSERT_TRUE(file_backend.load(file_backend.ctx, &magic, &size));
+    TEST_ASSERT_EQUAL_HEX32(PERSIST_MAGIC, magic);
+
+    // Detaching writes the current value, attaching again restores it
+    count = 7;
+    TEST_ASSERT_TRUE(pp_persist_detach(pcount));
+    TEST_ASSERT_EQUAL(2, stores);
+    count = 0;
+    gain = 0;
+    TEST_ASSERT_TRUE(pp_persist_attach(pcount, 0));
+    TEST_ASSERT_EQUAL(7, count);
+
+    TEST_ASSERT_TRUE(pp_persist_detach(pcount));
+    TEST_ASSERT_TRUE(pp_persist_detach(pgain));
+    TEST_ASSERT_FALSE(pp_persist_detach(pgain));
+    pp_delete(pcount);
+    pp_delete(pgain);
+    remove(PERSIST_PATH);
+}
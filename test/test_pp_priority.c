@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include "unity.h"
+#include "esp_event.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "pp.h"
+
+#define BULK_LEN 64
+#define BULK_BURST 40
+#define BULK_HANDLER_US 500
+#define SAMPLES 20
+// Define PP_TEST_HIGH_LATENCY_BOUND_US to also fail when the high class latency exceeds it, the
+// latency depends on the target and its load so by default it is only reported
+
+static pp_evloop_t owner = {.base = "prio_test_owner"};
+static pp_evloop_t receiver = {.base = "prio_test"};
+static pp_evloop_t fast = {.base = "prio_test_fast"};
+static volatile int64_t received_us = 0;
+static volatile int calls = 0;
+
+static void bulk_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    // A slow consumer, the bulk queue stays full while the test posts
+    int64_t until = esp_timer_get_time() + BULK_HANDLER_US;
+    while (esp_timer_get_time() < until)
+        ;
+}
+
+static void flag_event(void *arg, esp_event_base_t event_base, int32_t event_id, void *event_data)
+{
+    received_us = esp_timer_get_time();
+    calls++;
+}
+
+static esp_event_loop_handle_t create_loop(const char *task_name, int32_t queue_size, UBaseType_t priority)
+{
+    esp_event_loop_handle_t handle;
+    esp_event_loop_args_t args = {
+        .queue_size = queue_size,
+        .task_name = task_name,
+        .task_priority = priority,
+        .task_stack_size = 4096,
+        .task_core_id = 0,
+    };
+    TEST_ASSERT_EQUAL(ESP_OK, esp_event_loop_create(&args, &handle));
+    return handle;
+}
+
+/// @brief Post the bool after a burst of bulk posts and return its delivery latency.
+static int64_t measure(pp_t bulk, pp_float_array_t *array, pp_t flag)
+{
+    for (int i = 0; i < BULK_BURST; i++)
+        pp_post_newstate_float_array(bulk, array);
+    received_us = 0;
+    int64_t start = esp_timer_get_time();
+    pp_post_newstate_bool(flag, true);
+    while (received_us == 0 && esp_timer_get_time() - start < 1000000)
+        vTaskDelay(1);
+    TEST_ASSERT_NOT_EQUAL(0, received_us);
+    return received_us - start;
+}
+
+TEST_CASE("high priority events overtake a saturating bulk load", "[pp_priority][timing]")
+{
+    owner.loop_handle = create_loop(NULL, 16, 0);
+    receiver.loop_handle = create_loop("prio_bulk", 32, 5);
+    fast.loop_handle = create_loop("prio_fast", 8, 6);
+    TEST_ASSERT_TRUE(pp_set_fast_loop(&receiver, &fast));
+
+    static bool stop_value, normal_value;
+    pp_t bulk = pp_create_float_array("prio_test/bulk", &owner, NULL);
+    pp_t stop = pp_create_bool("prio_test/stop", &owner, NULL, &stop_value);
+    pp_t normal = pp_create_bool("prio_test/normal", &owner, NULL, &normal_value);
+    TEST_ASSERT_TRUE(pp_set_priority(stop, PP_PRIORITY_HIGH));
+    TEST_ASSERT_TRUE(pp_subscribe(bulk, &receiver, bulk_event));
+    TEST_ASSERT_TRUE(pp_subscribe(stop, &receiver, flag_event));
+    TEST_ASSERT_TRUE(pp_subscribe(normal, &receiver, flag_event));
+    pp_float_array_t *array = pp_allocate_float_array(BULK_LEN);
+
+    int64_t high_max = 0, normal_max = 0;
+    for (int i = 0; i < SAMPLES; i++)
+    {
+        int64_t high = measure(bulk, array, stop);
+        int64_t low = measure(bulk, array, normal);
+        high_max = high > high_max ? high : high_max;
+        normal_max = low > normal_max ? low : normal_max;
+    }
+    printf("latency under bulk load over %d samples: high max %lld us, normal max %lld us\n", SAMPLES,
+           (long long)high_max, (long long)normal_max);
+#ifdef PP_TEST_HIGH_LATENCY_BOUND_US
+    TEST_ASSERT_LESS_THAN(PP_TEST_HIGH_LATENCY_BOUND_US, high_max);
+#endif
+    // The normal class waits behind the whole burst, the high class does not
+    TEST_ASSERT_LESS_THAN(normal_max, high_max);
+
+    pp_unsubscribe(bulk, &receiver, bulk_event);
+    pp_unsubscribe(stop, &receiver, flag_event);
+    pp_unsubscribe(normal, &receiver, flag_event);
+    pp_set_fast_loop(&receiver, NULL);
+    pp_free(array);
+    pp_delete(bulk);
+    pp_delete(stop);
+    pp_delete(normal);
+    esp_event_loop_delete(owner.loop_handle);
+    esp_event_loop_delete(receiver.loop_handle);
+    esp_event_loop_delete(fast.loop_handle);
+}
+
+TEST_CASE("unsubscribe finds a high priority handler after the fast loop changed", "[pp_priority]")
+{
+    static bool value;
+    pp_evloop_t receiver_a = {.base = "prio_test_a"};
+    pp_evloop_t fast_a = {.base = "prio_test_a_fast"};
+    pp_evloop_t fast_b = {.base = "prio_test_b_fast"};
+    owner.loop_handle = create_loop(NULL, 16, 0);
+    receiver_a.loop_handle = create_loop(NULL, 8, 0);
+    fast_a.loop_handle = create_loop(NULL, 8, 0);
+    fast_b.loop_handle = create_loop(NULL, 8, 0);
+
+    pp_t p = pp_create_bool("prio_test/moved", &owner, NULL, &value);
+    TEST_ASSERT_TRUE(pp_set_fast_loop(&receiver_a, &fast_a));
+    TEST_ASSERT_TRUE(pp_subscribe_priority(p, &receiver_a, flag_event, PP_PRIORITY_HIGH));
+    TEST_ASSERT_TRUE(pp_set_fast_loop(&receiver_a, &fast_b));
+    TEST_ASSERT_TRUE(pp_unsubscribe(p, &receiver_a, flag_event));
+    TEST_ASSERT_EQUAL(0, pp_get_subscriptions(p));
+
+    // The handler is gone from the first fast loop as well
+    calls = 0;
+    pp_subscribe(p, &receiver_a, flag_event);
+    pp_post_newstate_bool(p, true);
+    esp_event_loop_run(fast_a.loop_handle, 0);
+    esp_event_loop_run(receiver_a.loop_handle, 0);
+    TEST_ASSERT_EQUAL(1, calls);
+
+    pp_set_fast_loop(&receiver_a, NULL);
+    pp_delete(p);
+    esp_event_loop_delete(owner.loop_handle);
+    esp_event_loop_delete(receiver_a.loop_handle);
+    esp_event_loop_delete(fast_a.loop_handle);
+    esp_event_loop_delete(fast_b.loop_handle);
+}
@@ -0,0 +1,86 @@
+#!/usr/bin/env python3
+"""Convert a pp_trace_dump() buffer to Chrome trace JSON, viewable in Perfetto or chrome://tracing.
+
+Each receiver event loop is a track, each post a slice named after the parameter, lasting as
+long as the post took. Failed posts are named "<param> FAILED".
+
+usage: pp_trace2json.py trace.bin [trace.json]
+"""
+
+import json
+import struct
+import sys
+
+MAGIC = 0x31545050
+ENTRY = struct.Struct("<IIHHBBBB")
+KINDS = {1: "newstate", 2: "newstate_irq", 3: "write", 4: "write_batch"}
+NO_PARAM = 0xFFFF
+NO_RECEIVER = 0xFF
+
+
+def parse(data):
+    magic, version, count, receiver_count, param_count = struct.unpack_from("<5I", data, 0)
+    if magic != MAGIC:
+        raise ValueError("not a pp trace dump")
+    if version != 1:
+        raise ValueError("unsupported trace version %d" % version)
+    offset = 20
+    receivers = []
+    for _ in range(receiver_count):
+        length = data[offset]
+        receivers.append(data[offset + 1:offset + 1 + length].decode(errors="replace"))
+        offset += 1 + length
+    params = {}
+    for _ in range(param_count):
+        index, length = struct.unpack_from("<HB", data, offset)
+        params[index] = data[offset + 3:offset + 3 + length].decode(errors="replace")
+        offset += 3 + length
+    entries = [ENTRY.unpack_from(data, offset + i * ENTRY.size) for i in range(count)]
+    return receivers, params, entries
+
+
+def convert(receivers, params, entries):
+    events = []
+    for tid, name in enumerate(receivers):
+        events.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": tid, "args": {"name": name}})
+    events.append({"ph": "M", "name": "thread_name", "pid": 0, "tid": NO_RECEIVER, "args": {"name": "other"}})
+
+    # Timestamps are the low 32 bits of the microsecond clock, unwrap them in recording order
+    base = 0
+    last = None
+    for timestamp, duration, param, size, kind, receiver, result, core in entries:
+        if last is not None and timestamp < last and last - timestamp > 0x80000000:
+            base += 1 << 32
+        last = timestamp
+        name = params.get(param, "batch" if param == NO_PARAM else "#%d" % param)
+        if result:
+            name += " FAILED"
+        events.append({
+            "ph": "X",
+            "name": name,
+            "cat": KINDS.get(kind, "unknown"),
+            "ts": base + timestamp,
+            "dur": max(duration, 1),
+            "pid": 0,
+            "tid": receiver,
+            "args": {"size": size, "core": core, "kind": KINDS.get(kind, kind)},
+        })
+    return {"traceEvents": events}
+
+
+def main(argv):
+    if len(argv) < 2:
+        print(__doc__.strip(), file=sys.stderr)
+        return 1
+    with open(argv[1], "rb") as f:
+        trace = convert(*parse(f.read()))
+    if len(argv) > 2:
+        with open(argv[2], "w") as f:
+            json.dump(trace, f)
+    else:
+        json.dump(trace, sys.stdout)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))